@@ -19,9 +19,66 @@
  *   - Static arena allocation (#define ARENA_NOALLOC): uses fixed-size
  *     static buffer specified by #define ARENA_SIZE.
  *   - Optional thread safety with user-defined ARENA_LOCK() / ARENA_UNLOCK().
+ *   - Optional memory trimming: arena_trim() and a retained size for
+ *     arena_reset() hand pages above the threshold back to the OS.
  *   - Simple API: init, alloc, alloc_aligned, reset, destroy, and error reporting.
  *   - No individual free calls; only whole-arena reset or destroy.
  *   - Optional namespace support for C++ via ARENA_NAMESPACE.
+ *   - Optional C++ adapters (#define ARENA_CXX, C++11 or later):
+ *     arena::allocator<T> for standard containers and, with C++17,
+ *     arena::memory_resource for std::pmr. With C++20, promise types that
+ *     derive from arena::frame_allocator put coroutine frames in an arena.
+ *   - Arenas over caller-provided memory (arena_init_buffer) and, in C++,
+ *     arena::static_arena<N, Align> with inline storage.
+ *   - Child arenas carved from a parent (arena_child), reset on their own
+ *     and invalidated when the parent resets or rewinds past them.
+ *   - Chained heap blocks: arena_transfer() moves the blocks allocated
+ *     since a mark to another arena without copying.
+ *   - Marks (arena_mark/arena_rewind) and per-thread scratch arenas
+ *     (arena_scratch_begin/arena_scratch_end) that avoid given conflicts.
+ *   - I/O buffers: arena_alloc_io() hands out ARENA_IO_ALIGN-aligned,
+ *     padded buffers for O_DIRECT; arena_readv() scatter-reads into them,
+ *     and arena_iovec() describes what was built since a mark for writev().
+ *   - Record indexing: arena_split()/arena_index_lines() build an offset
+ *     array of record boundaries with an SSE2/AVX2 delimiter scan (scalar
+ *     fallback); arena_read_file() (ARENA_POSIX) loads a file in one read.
+ *   - Real-time mode (ARENA_POSIX): arena_realtime()/arena_init_realtime()
+ *     pre-fault and mlock() the arena, report the warmup time and keep
+ *     every later arena call on it out of the kernel.
+ *   - Typed allocation (ARENA_NEW, arena::make<T>) and destructors that run
+ *     in LIFO order on reset/destroy via arena_add_cleanup().
+ *   - Overflow policy per arena (arena_set_overflow): a callback that can
+ *     grow, flush, spill or abort runs when an allocation does not fit,
+ *     then the allocation is retried once. Built in: arena_overflow_grow
+ *     (chains a new heap block) and arena_overflow_abort.
+ *   - Block cache (#define ARENA_BLOCK_CACHE): arena structs and blocks
+ *     freed by arena_destroy/reset/rewind are kept in a lock-free,
+ *     size-classed cache for the next arena_init or growth, up to a budget.
+ *   - Large-object bypass (arena_set_large_threshold): allocations above a
+ *     threshold get their own ARENA_MALLOC block, freed on reset/destroy,
+ *     so one outlier does not size the whole arena.
+ *   - Unknown-length writes: arena_reserve() hands out the whole free tail
+ *     and arena_commit() keeps only the bytes actually written.
+ *   - Segmented arrays (arena_seg_t, arena::segmented_array<T>): append
+ *     only, elements never move; power-of-two segments and a small
+ *     directory give O(1) indexing and contiguous runs to iterate.
+ *   - Strings: arena_strdup()/arena_memdup() and, with ARENA_STDIO,
+ *     arena_sprintf()/arena_vsprintf() that format straight into the free
+ *     tail and keep exactly the bytes written.
+ *   - Relocatable images (ARENA_POSIX): link objects with arena_off_t
+ *     offsets, arena_save() the arena in one writev() and arena_load() it
+ *     back as a read-only mmap() with no fixup.
+ *   - Persistent file-backed arenas (ARENA_POSIX): arena_init_file() maps a
+ *     file MAP_SHARED; arena_sync() makes allocations durable.
+ *   - Cross-process shared arenas (ARENA_POSIX): arena_init_shared() keeps
+ *     pos/capacity and data in shared memory and bumps pos atomically.
+ *   - Generation-checked handles: arena_reset() invalidates every
+ *     arena_handle_t, and arena_deref() catches stale ones with one compare.
+ *   - Usage stats (arena_stats, arena_set_name) and, with ARENA_REGISTRY,
+ *     a process-wide registry that arena_dump_stats() prints as text/JSON.
+ *   - Allocation tracing (#define ARENA_TRACE): init/alloc/reset/destroy
+ *     events go to a per-thread buffer and are flushed to a file or sink;
+ *     examples/arena/replay.c re-runs a trace and reports time and footprint.
  *
  * Usage Examples:
  * -------------
@@ -62,14 +119,206 @@
  * #define ARENA_UNLOCK() pthread_mutex_unlock(&lock)
  * pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
  *
+ * // 4. Standard containers in an arena (C++):
+ * #define ARENA_CXX
+ * #include "arena.h"
+ *
+ * std::vector<int, arena::allocator<int>> v{arena::allocator<int>(a)};
+ *
+ * arena::memory_resource res(a);
+ * std::pmr::unordered_map<int, int> m(&res);
+ *
+ * std::string *s = arena::make<std::string>(a, "hi"); // ~string on reset
+ *
+ * arena::static_arena<4096> scratch; // storage inline, no malloc
+ * int *xs = ARENA_NEW(scratch.get(), int, 16);
+ *
+ * // 5. Typed allocation and cleanups (C):
+ * struct conn *c = ARENA_NEW(a, struct conn, 1);
+ * arena_add_cleanup(a, conn_close, c); // runs on reset/destroy
+ *
+ * // 6. Relocatable images (ARENA_POSIX):
+ * struct node { arena_off_t next; int key; };
+ * struct node *root = ARENA_NEW(a, struct node, 1); // first alloc = root
+ * root->next = arena_off(a, ARENA_NEW(a, struct node, 1));
+ * arena_save(a, "table.img");
+ *
+ * arena_t *img = arena_load("table.img"); // read-only, zero-copy
+ * struct node *r = (struct node *)arena_ptr(img, 0);
+ * struct node *n = (struct node *)arena_ptr(img, r->next);
+ * arena_destroy(img);
+ *
+ * // 7. Persistent file-backed arena (ARENA_POSIX):
+ * arena_t *c = arena_init_file("cache.arena", 1 << 20); // reopens if present
+ * void *p = arena_alloc(c, 128); // same API as any other arena
+ * arena_sync(c);                 // pos + contents reach the file
+ * arena_destroy(c);              // unmaps, file is kept
+ *
+ * // 8. Shared between processes (ARENA_POSIX):
+ * arena_t *s = arena_init_shared(NULL, 1 << 20); // before fork(), or
+ * arena_t *s = arena_init_shared("/tables", 1 << 20); // shm_open() name
+ * void *p = arena_alloc(s, 128); // visible to every process mapping it
+ *
+ * // 9. Child arena for a subtask, no malloc:
+ * arena_t sub;
+ * arena_child(&sub, a, 16384);   // grows in place while it is a's newest block
+ * void *q = arena_alloc(&sub, 64);
+ * arena_reset(&sub);             // independent of a; a's reset kills sub
+ *
+ * // 10. Zero-copy handoff between pipeline stages:
+ * arena_mark_t m = arena_mark(stage_a);
+ * produce(stage_a);
+ * arena_transfer(stage_b, stage_a, m); // blocks now owned by stage_b
+ * arena_reset(stage_a);                // handed-off data stays valid
+ *
+ * // 11. Scratch memory without passing arenas around:
+ * arena_temp_t t = arena_scratch_begin(&a, 1); // any scratch arena but a
+ * char *tmp = (char *)arena_alloc(t.arena, 256);
+ * arena_scratch_end(t);                         // rewinds, tmp is gone
+ *
+ * // 12. O_DIRECT reads straight into the arena (ARENA_POSIX for readv):
+ * unsigned long lens[2] = {512, 10000};
+ * struct iovec iov[2];
+ * long n = arena_readv(a, fd, lens, 2, iov); // two 4 KiB-aligned buffers
+ *
+ * arena_mark_t m = arena_mark(a);
+ * build_response(a);                          // serialize into the arena
+ * int cnt = arena_iovec(a, m, iov, 2);
+ * writev(sock, iov, cnt);                     // no copy to a send buffer
+ *
+ * // 13. Files split into lines without per-line allocation:
+ * unsigned long len, n, i;
+ * char *text = (char *)arena_read_file(a, "input.txt", &len);
+ * unsigned long *offs = arena_index_lines(a, text, len, &n);
+ * for (i = 0; i < n; i++)
+ *     handle(text + offs[i], offs[i + 1] - offs[i] - 1); // line i, no '\n'
+ *
+ * // 14. Real-time arena (ARENA_POSIX):
+ * unsigned long warmup_ns;
+ * arena_t *rt = arena_init_realtime(1 << 20, &warmup_ns); // resident+locked
+ *
+ * // 15. Handles that detect use after reset:
+ * arena_handle_t h = arena_handle(a, arena_alloc(a, 64));
+ * arena_reset(a);
+ * if (!arena_deref(a, h)) { ... } // stale: NULL instead of reused memory
+ *
+ * // 16. Which arena holds the memory? (#define ARENA_REGISTRY)
+ * arena_set_name(a, "parser");
+ * arena_dump_stats(write_cb, stderr, ARENA_DUMP_JSON); // every live arena
+ *
+ * // 17. Recording a workload (#define ARENA_TRACE, plus ARENA_POSIX here):
+ * arena_trace_open("app.trace");
+ * run_workload();
+ * arena_trace_stop(); // then: replay app.trace -c 65536
+ *
+ * // 18. Strings (arena_sprintf needs #define ARENA_STDIO):
+ * char *key = arena_sprintf(a, "%s:%d", user, id); // one vsnprintf pass
+ * char *copy = arena_strdup(a, key);
+ *
+ * // 19. Reading an unknown amount without slack:
+ * unsigned long avail;
+ * char *buf = arena_reserve(a, 4096, &avail); // at least 4096 bytes
+ * ssize_t n = read(fd, buf, avail);
+ * arena_commit(a, n > 0 ? n : 0);             // keep only what was read
+ *
+ * // 20. Never NULL: grow on overflow (or flush/abort with your own handler):
+ * arena_set_overflow(a, arena_overflow_grow, NULL); // ctx: &byte_limit
+ * char *big = arena_alloc(a, 1 << 24);              // chains a new block
+ *
+ * // 21. Outliers bypass the arena (arenas from arena_init only):
+ * arena_set_large_threshold(a, 64 * 1024);
+ * void *blob = arena_alloc(a, 8 << 20); // own block, freed by arena_reset
+ *
+ * // 22. Coroutine frames in the request's arena (C++20, ARENA_CXX):
+ * struct promise_type : arena::frame_allocator { ... };
+ * task handle(arena_t *req, int fd);  // frame taken from req
+ * { arena::current_arena use(req); spawn(); } // or from the current arena
+ *
+ * // 23. Node pool whose pointers stay valid as it grows:
+ * arena_seg_t nodes;
+ * ARENA_SEG_INIT(&nodes, a, node_t, 64);  // segments of 64, 128, 256, ...
+ * node_t *n = arena_seg_push(&nodes);     // never moves
+ * for (k = 0; (run = arena_seg_segment(&nodes, k, &len)); k++) { ... }
+ *
  * Notes:
  * ------
  * - Only whole-arena reset or destroy; no per-allocation free.
  * - arena_alloc_aligned() provides aligned allocations (alignment must be
  *   power of two).
- * - arena_error() returns last error message for debugging.
+ * - Failures are reported as arena_err_t codes: arena_last_error() is the
+ *   calling thread's last one, and arena_t keeps the last failure on that
+ *   arena. Successful calls write neither, so allocating only touches pos.
+ *   arena_error()/arena_strerror() turn codes into messages on demand.
+ * - arena_trim() and the arena_set_retain() policy release whole pages only,
+ *   through ARENA_DECOMMIT(ptr, size) (madvise(MADV_DONTNEED) with
+ *   ARENA_POSIX; define it as MADV_FREE or your own hook if preferred).
+ * - Images store offsets, so they load at any address, but they are only
+ *   portable between builds with the same sizeof(long) and byte order.
+ *   Alignment beyond that of the saved arena's data pointer (16 bytes for
+ *   typical malloc) is not preserved across a load.
  * - Configurable allocation functions via ARENA_MALLOC/ARENA_FREE macros.
+ * - The registry holds up to ARENA_REGISTRY_SLOTS arenas (from arena_init,
+ *   arena_load, arena_init_file and arena_init_shared); slots are claimed
+ *   with a CAS, so joining and leaving never take ARENA_LOCK. Arenas that
+ *   find it full still work and are counted as untracked. Names are not
+ *   copied and must outlive the arena.
+ * - Trace files are a header (ARENA_TRACE_MAGIC, ARENA_TRACE_VERSION) and
+ *   arena_trace_event_t records in native layout. Each thread buffers
+ *   ARENA_TRACE_EVENTS records and flushes them when full, on
+ *   arena_trace_flush() and (ARENA_POSIX) at thread exit, so records of
+ *   different threads are ordered by time_ns, not by file position.
+ *   Timestamps come from ARENA_TRACE_CLOCK() (CLOCK_MONOTONIC with
+ *   ARENA_POSIX, else 0 unless you define it).
  * - Compatible with C and C++ (with optional namespace support).
+ * - #define ARENA_POSIX to enable features built on POSIX system calls
+ *   (madvise, mmap, shm_open, ...). Without it, ARENA_DECOMMIT() is a
+ *   no-op unless you provide your own. Under strict -std=c99 and similar
+ *   modes, also define _DEFAULT_SOURCE (or _GNU_SOURCE) for MAP_ANONYMOUS
+ *   and friends.
+ * - #define ARENA_STDIO for arena_sprintf()/arena_vsprintf() (vsnprintf;
+ *   also va_copy, or __va_copy under C89 with GCC/Clang).
+ *   They measure and write in one pass while the formatted string fits
+ *   the current tail, and format a second time only when it does not.
+ * - Overflow handlers run without ARENA_LOCK held and may call anything on
+ *   the arena, but allocations they make from it do not re-enter the
+ *   handler. One thread at a time runs an arena's handler; others that
+ *   overflow meanwhile wait for it and retry. Each handler run gets one
+ *   retry, repeated only if other threads took the room it made first.
+ *   arena_reserve() calls the handler too. arena_overflow_grow refuses
+ *   real-time and non-heap arenas (static, buffer, child, file-backed); it
+ *   adds blocks of the current capacity, or of the request if larger.
+ *   arena_overflow_abort calls ARENA_ABORT() (__builtin_trap() on
+ *   GCC/Clang, else abort()).
+ * - The block cache rounds block capacities up to a power of two between
+ *   2^ARENA_BLOCK_CACHE_MIN_SHIFT and that times 2^(classes - 1) when it
+ *   allocates them (the arena still sees the size it asked for); larger
+ *   blocks bypass it. Each class keeps up to ARENA_BLOCK_CACHE_SLOTS
+ *   blocks, and at most ARENA_BLOCK_CACHE_BUDGET bytes are kept overall.
+ *   Slots are taken with an atomic exchange, so there is no ABA problem
+ *   and no lock. arena_cache_trim() hands everything back to ARENA_FREE.
+ * - Coroutine frames are taken from the first arena_t * argument of the
+ *   coroutine, else from arena::current_arena::get(), else (and when the
+ *   arena is full) from the global operator new. A small header before
+ *   each frame records which, so destroying a frame frees heap frames and
+ *   leaves arena frames to arena_reset; reset only once every coroutine
+ *   allocated from the arena has been destroyed. GCC 12 reports a false
+ *   -Wmismatched-new-delete at each coroutine definition because of the
+ *   template operator new; silence it there if you build with -Werror.
+ * - Large objects are not part of the arena's blocks: arena_reserve() never
+ *   sees them, and arena_iovec() and arena_save() fail with
+ *   ARENA_E_UNSUPPORTED rather than leave them out. Rewind, transfer and
+ *   stats include them.
+ *   Real-time arenas keep allocating in place whatever the threshold.
+ * - A reservation is not an allocation: any other call that allocates,
+ *   resets or rewinds the arena before arena_commit() cancels it (commit
+ *   then fails), and it does not keep other threads out of the tail.
+ * - arena_strdup()/arena_memdup() copy through ARENA_MEMCPY(dst, src, n)
+ *   (__builtin_memcpy on GCC/Clang, a byte loop otherwise).
+ * - A segmented array is not locked (one writer at a time) and lives only
+ *   as long as its segments: arena_seg_push() fails with ARENA_E_STATE
+ *   after arena_reset(), and rewinding past a segment is not detected.
+ *   Segment k holds first << k elements; k is bounded by the 64-entry
+ *   directory and by shift + k < bits of unsigned long.
  *
  * License:
  * --------
@@ -82,11 +331,47 @@
 #ifndef ARENA_H
 #define ARENA_H
 
+#if !defined(__cplusplus) && !(defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L)
+#include <stddef.h> /* offsetof, for ARENA_ALIGNOF */
+#endif
+
+#ifdef ARENA_POSIX
+#include <sys/mman.h>
+#include <sys/uio.h> /* struct iovec */
+#endif
+
+#ifdef ARENA_STDIO
+#include <stdarg.h>
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    /* ============================================================================
+     * Error Codes
+     * ============================================================================
+     */
+    typedef enum arena_err_t
+    {
+        ARENA_OK = 0,
+        ARENA_E_NULL,         /* NULL arena or required argument */
+        ARENA_E_SIZE,         /* Size is zero, negative or too large */
+        ARENA_E_ALIGN,        /* Alignment is not a power of two */
+        ARENA_E_OVERFLOW,     /* Does not fit (and no overflow handler helped) */
+        ARENA_E_NOMEM,        /* ARENA_MALLOC failed */
+        ARENA_E_READONLY,     /* Arena may not change */
+        ARENA_E_MARK,         /* Mark does not belong to the arena */
+        ARENA_E_PARENT_RESET, /* Child arena's parent was reset or rewound */
+        ARENA_E_UNSUPPORTED,  /* Not possible for this kind of arena */
+        ARENA_E_STATE,        /* Call out of sequence (e.g. commit without reserve) */
+        ARENA_E_CONFLICT,     /* Every scratch arena is in the conflict list */
+        ARENA_E_ARGUMENT,     /* Other invalid argument */
+        ARENA_E_IO,           /* A system call failed */
+        ARENA_E_FORMAT        /* File or shared memory is not an arena */
+    } arena_err_t;
+
     /* ============================================================================
      * Arena Structure
      * ============================================================================
@@ -96,13 +381,109 @@ extern "C"
         unsigned char *data;    /* Pointer to arena memory */
         unsigned long capacity; /* Total size in bytes */
         unsigned long pos;      /* Current offset / allocation position */
-        const char *error;      /* Last error string (per arena) */
+        arena_err_t error;      /* Last failure on this arena, see arena_error */
+        unsigned long peak;     /* Highest pos in this block since the last trim */
+        unsigned long high_water; /* Most bytes ever in use, see arena_stats */
+        unsigned long retain;   /* Bytes kept committed by arena_reset; ~0UL: all */
+        struct _arena_cleanup *cleanups; /* Registered cleanups, newest first */
+        unsigned int flags;     /* Backing store / mode (_ARENA_FLAG_*) */
+        unsigned long generation; /* Bumped by arena_reset, see arena_handle_t */
+        struct arena_t *parent; /* Arena a child was carved from, else NULL */
+        unsigned long parent_gen; /* parent->generation when the child was made */
+        struct _arena_block *blocks; /* Older heap blocks, newest first */
+        const char *name;       /* Label for stats dumps, see arena_set_name */
+        int (*on_overflow)(struct arena_t *, unsigned long, unsigned long, void *);
+        void *overflow_ctx;     /* Passed to on_overflow */
+        struct _arena_large *large; /* Bypass allocations, newest first */
+        unsigned long large_threshold; /* Sizes above this bypass; ~0UL: off */
+        unsigned char *reserved; /* Span of the open arena_reserve, else NULL */
+        unsigned long reserved_len; /* Its length */
+        unsigned long id;       /* Arena id in trace events (ARENA_TRACE), else 0 */
     } arena_t;
 
+    /* Offset of an object from arena->data; stays valid across save/load */
+    typedef unsigned long arena_off_t;
+#define ARENA_OFF_NULL ((arena_off_t)-1)
+
+    /* Pointer plus the generation it was taken in; stale after arena_reset */
+    typedef struct arena_handle_t
+    {
+        void *ptr;
+        unsigned long gen;
+    } arena_handle_t;
+#define ARENA_GEN_NULL ((unsigned long)-1) /* Never a live generation */
+
+    /* Cleanup callback run by arena_reset/arena_destroy */
+    typedef void (*arena_cleanup_fn)(void *ctx);
+
+    /* Allocation position to rewind to, see arena_mark/arena_rewind */
+    typedef struct arena_mark_t
+    {
+        unsigned char *data;             /* Block the mark lies in */
+        unsigned long pos;               /* Offset within that block */
+        struct _arena_cleanup *cleanups; /* Newest cleanup when marked */
+        struct _arena_large *large;      /* Newest large object when marked */
+    } arena_mark_t;
+
+    /* Usage snapshot filled in by arena_stats */
+    typedef struct arena_stats_t
+    {
+        const char *name;       /* NULL if never named */
+        unsigned long capacity; /* Bytes in all blocks */
+        unsigned long used;     /* Bytes allocated */
+        unsigned long peak;     /* High-water mark of used */
+        unsigned long blocks;   /* Blocks owned, large objects included */
+    } arena_stats_t;
+
+    /* Called when an allocation of size bytes does not fit; return nonzero
+     * once room was made to have it retried. See arena_set_overflow. */
+    typedef int (*arena_overflow_fn)(struct arena_t *arena, unsigned long size,
+                                     unsigned long alignment, void *ctx);
+
+    /* Output sink for arena_dump_stats; called with chunks of the dump */
+    typedef void (*arena_write_fn)(void *ctx, const char *buf, unsigned long len);
+
+    /* One trace record; see ARENA_TRACE */
+    typedef struct arena_trace_event_t
+    {
+        unsigned long time_ns;   /* ARENA_TRACE_CLOCK() */
+        unsigned long arena;     /* Arena id */
+        unsigned long type;      /* ARENA_TRACE_INIT, ... */
+        unsigned long size;      /* Requested bytes; capacity for INIT */
+        unsigned long alignment; /* ALLOC_ALIGNED only, else 0 */
+    } arena_trace_event_t;
+
+    /* Scratch arena together with the mark arena_scratch_end rewinds to */
+    typedef struct arena_temp_t
+    {
+        arena_t *arena;
+        arena_mark_t mark;
+    } arena_temp_t;
+
+/* Fixed, so every translation unit agrees on sizeof(arena_seg_t); shift + k
+ * stays below the bits of unsigned long anyway */
+#define ARENA_SEG_DIR 64
+
+    /* Append-only array of power-of-two segments, see arena_seg_init */
+    typedef struct arena_seg_t
+    {
+        arena_t *arena;          /* Arena the segments come from */
+        unsigned long elem_size; /* Element stride, a multiple of alignment */
+        unsigned long alignment; /* Element alignment */
+        unsigned long count;     /* Elements pushed */
+        unsigned long gen;       /* arena->generation at arena_seg_init */
+        int shift;               /* Segment 0 holds 1 << shift elements */
+        int segments;            /* Segments allocated */
+        unsigned char *dir[ARENA_SEG_DIR]; /* Segment k holds 1 << (shift + k) */
+    } arena_seg_t;
+
 /* ============================================================================
  * Function Prefixing
  * ============================================================================
  */
+/* Functions whose bare name would clash with libc/POSIX (e.g. sync) always
+ * keep the arena_ prefix; ARENA_NAMESPACE exposes them through inline
+ * forwarders instead. */
 #ifdef ARENA_NAMESPACE
 #define _ARENA_PREFIX(name) name
 #else
@@ -121,6 +502,150 @@ extern "C"
 #define ARENA_UNLOCK()
 #endif
 
+/* Storage class for the small functions defined in this header */
+#ifndef ARENA_INLINE
+#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define ARENA_INLINE static inline
+#elif defined(__GNUC__)
+#define ARENA_INLINE static __inline__
+#else
+#define ARENA_INLINE static
+#endif
+#endif
+
+/* Storage class for per-thread state (scratch arenas) */
+#ifndef ARENA_TLS
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define ARENA_TLS thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define ARENA_TLS _Thread_local
+#elif defined(__GNUC__)
+#define ARENA_TLS __thread
+#else
+#define ARENA_TLS
+#endif
+#endif
+
+/* ============================================================================
+ * Scratch Arenas (dynamic mode only)
+ * ============================================================================
+ */
+#ifndef ARENA_SCRATCH_COUNT
+#define ARENA_SCRATCH_COUNT 2
+#endif
+
+#ifndef ARENA_SCRATCH_SIZE
+#define ARENA_SCRATCH_SIZE (1 << 20)
+#endif
+
+/* ============================================================================
+ * Registry (optional, #define ARENA_REGISTRY)
+ * ============================================================================
+ */
+#ifndef ARENA_REGISTRY_SLOTS
+#define ARENA_REGISTRY_SLOTS 256
+#endif
+
+#define ARENA_DUMP_TEXT 0
+#define ARENA_DUMP_JSON 1
+
+/* ============================================================================
+ * Block Cache (optional, #define ARENA_BLOCK_CACHE)
+ * ============================================================================
+ */
+#ifndef ARENA_BLOCK_CACHE_MIN_SHIFT
+#define ARENA_BLOCK_CACHE_MIN_SHIFT 12 /* Smallest class: 4 KiB */
+#endif
+
+#ifndef ARENA_BLOCK_CACHE_CLASSES
+#define ARENA_BLOCK_CACHE_CLASSES 16 /* Up to 128 MiB with the default */
+#endif
+
+#ifndef ARENA_BLOCK_CACHE_SLOTS
+#define ARENA_BLOCK_CACHE_SLOTS 8 /* Blocks kept per class */
+#endif
+
+#ifndef ARENA_BLOCK_CACHE_BUDGET
+#define ARENA_BLOCK_CACHE_BUDGET (64UL << 20) /* Bytes kept in all classes */
+#endif
+
+/* ============================================================================
+ * Tracing (optional, #define ARENA_TRACE)
+ * ============================================================================
+ */
+#ifndef ARENA_TRACE_EVENTS
+#define ARENA_TRACE_EVENTS 512 /* Records buffered per thread */
+#endif
+
+#define ARENA_TRACE_MAGIC (0x54524e41UL + (unsigned long)sizeof(unsigned long)) /* "ANRT" */
+#define ARENA_TRACE_VERSION 1UL
+
+#define ARENA_TRACE_INIT 1UL
+#define ARENA_TRACE_ALLOC 2UL
+#define ARENA_TRACE_ALLOC_ALIGNED 3UL
+#define ARENA_TRACE_RESET 4UL
+#define ARENA_TRACE_DESTROY 5UL
+
+/* ============================================================================
+ * Abort Hook (optional), used by arena_overflow_abort
+ * ============================================================================
+ */
+#ifndef ARENA_ABORT
+#if defined(__GNUC__) || defined(__clang__)
+#define ARENA_ABORT() __builtin_trap()
+#else
+#define ARENA_ABORT() abort()
+#endif
+#endif
+
+/* ============================================================================
+ * Copy Hook (optional)
+ * ============================================================================
+ */
+#ifndef ARENA_MEMCPY
+#if defined(__GNUC__) || defined(__clang__)
+#define ARENA_MEMCPY(dst, src, n) __builtin_memcpy((dst), (src), (n))
+#else
+#define ARENA_MEMCPY(dst, src, n) _arena_memcpy((dst), (src), (n))
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _ARENA_PRINTF(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define _ARENA_PRINTF(fmt, args)
+#endif
+
+/* ============================================================================
+ * Page Release Hooks (optional)
+ * ============================================================================
+ */
+#ifndef ARENA_PAGE_SIZE
+#define ARENA_PAGE_SIZE 4096UL
+#endif
+
+/* Alignment and length granularity of arena_alloc_io (O_DIRECT sectors) */
+#ifndef ARENA_IO_ALIGN
+#define ARENA_IO_ALIGN 4096UL
+#endif
+
+#if (ARENA_IO_ALIGN & (ARENA_IO_ALIGN - 1)) != 0
+#error "ARENA_IO_ALIGN must be a power of two"
+#endif
+
+/* Bytes reserved ahead of the data in image and file-backed arenas */
+#ifndef ARENA_FILE_HEADER_SIZE
+#define ARENA_FILE_HEADER_SIZE 64UL
+#endif
+
+#ifndef ARENA_DECOMMIT
+#ifdef ARENA_POSIX
+#define ARENA_DECOMMIT(ptr, size) madvise((ptr), (size), MADV_DONTNEED)
+#else
+#define ARENA_DECOMMIT(ptr, size) ((void)0)
+#endif
+#endif
+
 /* ============================================================================
  * Allocation Hooks (unless NOALLOC is defined)
  * ============================================================================
@@ -146,254 +671,4068 @@ extern "C"
 #else
     arena_t *_ARENA_PREFIX(init)(int size);
 #endif
+    arena_t *_ARENA_PREFIX(init_buffer)(arena_t *arena, void *buffer, int size);
+    arena_t *_ARENA_PREFIX(child)(arena_t *child, arena_t *parent, int size);
     void *_ARENA_PREFIX(alloc)(arena_t *arena, int size);
     void *_ARENA_PREFIX(alloc_aligned)(arena_t *arena, int size, int alignment);
+    void *_ARENA_PREFIX(alloc_io)(arena_t *arena, unsigned long size, unsigned long *padded);
+    void *_ARENA_PREFIX(reserve)(arena_t *arena, unsigned long min, unsigned long *avail);
+    int _ARENA_PREFIX(commit)(arena_t *arena, unsigned long used);
+    void _ARENA_PREFIX(set_overflow)(arena_t *arena, arena_overflow_fn fn, void *ctx);
+    int _ARENA_PREFIX(overflow_abort)(arena_t *arena, unsigned long size, unsigned long alignment, void *ctx);
+#if defined(ARENA_BLOCK_CACHE) && !defined(ARENA_NOALLOC)
+    void _ARENA_PREFIX(cache_trim)(void);
+#endif
+#ifndef ARENA_NOALLOC
+    int _ARENA_PREFIX(overflow_grow)(arena_t *arena, unsigned long size, unsigned long alignment, void *ctx);
+    int _ARENA_PREFIX(set_large_threshold)(arena_t *arena, unsigned long bytes);
+#endif
+    unsigned long *_ARENA_PREFIX(split)(arena_t *arena, const void *buf, unsigned long len, int delim,
+                                        unsigned long *count);
+    unsigned long *_ARENA_PREFIX(index_lines)(arena_t *arena, const void *buf, unsigned long len,
+                                              unsigned long *count);
     void _ARENA_PREFIX(reset)(arena_t *arena);
+    arena_mark_t _ARENA_PREFIX(mark)(arena_t *arena);
+    void arena_rewind(arena_t *arena, arena_mark_t mark);
+    void _ARENA_PREFIX(set_retain)(arena_t *arena, unsigned long bytes);
+    unsigned long _ARENA_PREFIX(trim)(arena_t *arena, unsigned long keep);
 #ifndef ARENA_NOALLOC
     void _ARENA_PREFIX(destroy)(arena_t *arena);
+    int _ARENA_PREFIX(transfer)(arena_t *dst, arena_t *src, arena_mark_t mark);
+    arena_temp_t _ARENA_PREFIX(scratch_begin)(arena_t *const *conflicts, int count);
+    void _ARENA_PREFIX(scratch_end)(arena_temp_t temp);
 #endif
     const char *_ARENA_PREFIX(error)(arena_t *arena);
-#ifdef __cplusplus
-} /* extern "C" */
-
-#ifdef ARENA_NAMESPACE
-namespace arena
-{
-    using ::alloc;
-    using ::alloc_aligned;
-    using ::arena_t;
-    using ::error;
-    using ::init;
-    using ::reset;
-#ifndef ARENA_NOALLOC
-    using ::destroy;
+    arena_err_t _ARENA_PREFIX(last_error)(void);
+    const char *arena_strerror(arena_err_t code);
+    int _ARENA_PREFIX(add_cleanup)(arena_t *arena, arena_cleanup_fn fn, void *ctx);
+    void *_ARENA_PREFIX(memdup)(arena_t *arena, const void *src, unsigned long len);
+    char *arena_strdup(arena_t *arena, const char *str);
+#ifdef ARENA_STDIO
+    char *arena_sprintf(arena_t *arena, const char *fmt, ...) _ARENA_PRINTF(2, 3);
+    char *arena_vsprintf(arena_t *arena, const char *fmt, va_list ap) _ARENA_PRINTF(2, 0);
+#endif
+    int _ARENA_PREFIX(seg_init)(arena_seg_t *seg, arena_t *arena, unsigned long elem_size,
+                                unsigned long alignment, unsigned long first);
+    void *_ARENA_PREFIX(seg_push)(arena_seg_t *seg);
+    void _ARENA_PREFIX(set_name)(arena_t *arena, const char *name);
+    int _ARENA_PREFIX(stats)(arena_t *arena, arena_stats_t *stats);
+#ifdef ARENA_REGISTRY
+    int _ARENA_PREFIX(dump_stats)(arena_write_fn write, void *ctx, int format);
+#endif
+#ifdef ARENA_TRACE
+    int _ARENA_PREFIX(trace_start)(arena_write_fn write, void *ctx);
+    void _ARENA_PREFIX(trace_flush)(void);
+    void _ARENA_PREFIX(trace_stop)(void);
+#ifdef ARENA_POSIX
+    int _ARENA_PREFIX(trace_open)(const char *path);
+#endif
 #endif
-}
-#endif /* ARENA_NAMESPACE */
-#endif /* __cplusplus */
-
-#ifdef ARENA_IMPLEMENTATION
-
-/* ============================================================================
- * Internal default error string when arena pointer is NULL
- * ============================================================================
- */
-static const char *_arena_error_global = "no error";
-
-/* ============================================================================
- * arena_error - returns the last error string for the arena, or global if NULL
- * ============================================================================
- */
-const char *_ARENA_PREFIX(error)(arena_t *arena)
-{
-    if (arena)
-        return arena->error ? arena->error : "no error";
-    return _arena_error_global;
-}
 
 /* ============================================================================
- * Static Arena (if NOALLOC is enabled)
+ * Typed Allocation
+ * ARENA_NEW(a, T, n) returns storage for n objects of type T, aligned for T,
+ * or NULL (ARENA_E_SIZE) if n * sizeof(T) does not fit in an int.
  * ============================================================================
  */
-#ifdef ARENA_NOALLOC
-#ifndef ARENA_SIZE
-#error "ARENA_SIZE must be defined when using ARENA_NOALLOC"
+#if defined(__cplusplus)
+#define ARENA_ALIGNOF(T) alignof(T)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define ARENA_ALIGNOF(T) _Alignof(T)
+#else
+#define ARENA_ALIGNOF(T) offsetof(struct { char c; T t; }, t)
 #endif
 
-static unsigned char _arena_static_data[ARENA_SIZE];
-static arena_t _arena_static = {_arena_static_data, ARENA_SIZE, 0, NULL};
-static int _arena_static_used = 0;
-#endif
+    void *_arena_new(arena_t *arena, unsigned long count, unsigned long size, unsigned long alignment);
+
+#define ARENA_NEW(a, T, n) \
+    ((T *)_arena_new((a), (unsigned long)(n), sizeof(T), ARENA_ALIGNOF(T)))
 
 /* ============================================================================
- * arena_init
+ * Segmented Arrays
+ * arena_seg_at() indexes through the segment directory in O(1);
+ * arena_seg_segment() returns segment k and how many elements it holds,
+ * NULL past the last one, for iterating run by run.
+ * ARENA_SEG_INIT(s, a, T, first) sets s up for elements of type T.
  * ============================================================================
  */
-#ifdef ARENA_NOALLOC
-arena_t *_ARENA_PREFIX(init)(void)
-{
-    ARENA_LOCK();
+#define ARENA_SEG_INIT(s, a, T, first) \
+    _ARENA_PREFIX(seg_init)((s), (a), sizeof(T), ARENA_ALIGNOF(T), (first))
 
-    if (_arena_static_used)
+    /* Index of the highest set bit of n (n > 0) */
+    ARENA_INLINE int _arena_log2(unsigned long n)
     {
-        _arena_static.error = "static arena already used";
-        ARENA_UNLOCK();
-        return NULL;
-    }
-
-    _arena_static.pos = 0;
-    _arena_static.error = "no error";
-    _arena_static_used = 1;
-
-    ARENA_UNLOCK();
-    return &_arena_static;
-}
+#if defined(__GNUC__) || defined(__clang__)
+        return (int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl(n);
 #else
-arena_t *_ARENA_PREFIX(init)(int size)
-{
-    ARENA_LOCK();
-
-    arena_t *arena = (arena_t *)ARENA_MALLOC(sizeof(arena_t));
-    if (!arena)
-    {
-        _arena_error_global = "out of memory (arena struct)";
-        ARENA_UNLOCK();
-        return NULL;
+        int k = 0;
+        while (n >>= 1)
+            k++;
+        return k;
+#endif
     }
 
-    arena->data = (unsigned char *)ARENA_MALLOC(size);
-    if (!arena->data)
+    ARENA_INLINE void *_ARENA_PREFIX(seg_at)(const arena_seg_t *seg, unsigned long i)
     {
-        ARENA_FREE(arena);
-        _arena_error_global = "out of memory (arena data)";
-        ARENA_UNLOCK();
-        return NULL;
+        int k;
+
+        if (i >= seg->count)
+            return 0;
+        k = _arena_log2((i >> seg->shift) + 1);
+        return seg->dir[k] + (i - (((1UL << k) - 1) << seg->shift)) * seg->elem_size;
     }
 
-    arena->capacity = size;
-    arena->pos = 0;
-    arena->error = "no error";
+    ARENA_INLINE void *_ARENA_PREFIX(seg_segment)(const arena_seg_t *seg, int k, unsigned long *n)
+    {
+        unsigned long start;
 
-    ARENA_UNLOCK();
-    return arena;
-}
-#endif
+        *n = 0;
+        if (k < 0 || k >= seg->segments)
+            return 0;
+        start = ((1UL << k) - 1) << seg->shift;
+        if (seg->count <= start)
+            return 0;
+        *n = seg->count - start;
+        if (*n > 1UL << (seg->shift + k))
+            *n = 1UL << (seg->shift + k);
+        return seg->dir[k];
+    }
 
 /* ============================================================================
- * arena_alloc
- * Allocates memory without alignment guarantees.
+ * Offset Pointers
+ * arena_off() / arena_ptr() convert between pointers and arena_off_t;
+ * NULL maps to ARENA_OFF_NULL and back. Offsets are relative to the
+ * current block, so they do not survive arena_transfer().
  * ============================================================================
  */
-void *_ARENA_PREFIX(alloc)(arena_t *arena, int size)
-{
-    if (!arena)
-    {
-        _arena_error_global = "null arena";
-        return NULL;
-    }
-
-    if (size <= 0)
+    ARENA_INLINE arena_off_t _ARENA_PREFIX(off)(const arena_t *arena, const void *ptr)
     {
-        arena->error = "invalid allocation size";
-        return NULL;
+        if (!ptr)
+            return ARENA_OFF_NULL;
+        return (arena_off_t)((const unsigned char *)ptr - arena->data);
     }
 
-    ARENA_LOCK();
-
-    if (arena->pos + (unsigned long)size > arena->capacity)
+    ARENA_INLINE void *_ARENA_PREFIX(ptr)(const arena_t *arena, arena_off_t off)
     {
-        arena->error = "arena overflow";
-        ARENA_UNLOCK();
-        return NULL;
+        if (off == ARENA_OFF_NULL)
+            return 0;
+        return arena->data + off;
     }
 
-    void *ptr = arena->data + arena->pos;
-    arena->pos += size;
-    arena->error = "no error";
-
-    ARENA_UNLOCK();
-    return ptr;
-}
-
 /* ============================================================================
- * arena_alloc_aligned
- * Allocates memory with specified alignment (must be power of two).
+ * Generation-Checked Handles
+ * arena_deref() returns NULL for handles taken before the last arena_reset
+ * (and for the handle of a NULL pointer).
  * ============================================================================
  */
-void *_ARENA_PREFIX(alloc_aligned)(arena_t *arena, int size, int alignment)
-{
-    if (!arena)
+    ARENA_INLINE arena_handle_t _ARENA_PREFIX(handle)(const arena_t *arena, const void *ptr)
     {
-        _arena_error_global = "null arena";
-        return NULL;
+        arena_handle_t h;
+        h.ptr = (void *)ptr;
+        h.gen = ptr ? arena->generation : ARENA_GEN_NULL;
+        return h;
     }
 
-    if (size <= 0)
+    ARENA_INLINE void *_ARENA_PREFIX(deref)(const arena_t *arena, arena_handle_t h)
     {
-        arena->error = "invalid allocation size";
-        return NULL;
+        return h.gen == arena->generation ? h.ptr : 0;
     }
 
-    if (alignment <= 0 || (alignment & (alignment - 1)) != 0)
-    {
-        arena->error = "alignment must be power of two";
-        return NULL;
-    }
+/* ============================================================================
+ * Images (ARENA_POSIX, dynamic mode only)
+ * ============================================================================
+ */
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+    int _ARENA_PREFIX(save)(arena_t *arena, const char *path);
+    arena_t *_ARENA_PREFIX(load)(const char *path);
+    arena_t *_ARENA_PREFIX(init_file)(const char *path, int size);
+    int arena_sync(arena_t *arena);
+    arena_t *_ARENA_PREFIX(init_shared)(const char *name, int size);
+#endif
 
-    ARENA_LOCK();
+#ifdef ARENA_POSIX
+    long arena_readv(arena_t *arena, int fd, const unsigned long *lens, int count, struct iovec *iov);
+    int arena_iovec(arena_t *arena, arena_mark_t from, struct iovec *iov, int max);
+    void *_ARENA_PREFIX(read_file)(arena_t *arena, const char *path, unsigned long *len);
+    int _ARENA_PREFIX(realtime)(arena_t *arena, unsigned long *warmup_ns);
+#ifndef ARENA_NOALLOC
+    arena_t *_ARENA_PREFIX(init_realtime)(int size, unsigned long *warmup_ns);
+#endif
+#endif
 
-    unsigned long current_addr = (unsigned long)(arena->data + arena->pos);
-    unsigned long offset = (alignment - (current_addr % alignment)) % alignment;
-    unsigned long new_pos = arena->pos + offset;
+#ifdef __cplusplus
+} /* extern "C" */
 
-    if (new_pos + (unsigned long)size > arena->capacity)
-    {
-        arena->error = "arena overflow (aligned)";
+#ifdef ARENA_NAMESPACE
+namespace arena
+{
+    using ::alloc;
+    using ::alloc_aligned;
+    using ::alloc_io;
+    using ::reserve;
+    using ::commit;
+    using ::arena_overflow_fn;
+    using ::set_overflow;
+    using ::overflow_abort;
+#if defined(ARENA_BLOCK_CACHE) && !defined(ARENA_NOALLOC)
+    using ::cache_trim;
+#endif
+#ifndef ARENA_NOALLOC
+    using ::overflow_grow;
+    using ::set_large_threshold;
+#endif
+    using ::index_lines;
+    using ::split;
+#ifdef ARENA_POSIX
+    using ::read_file;
+    using ::realtime;
+#ifndef ARENA_NOALLOC
+    using ::init_realtime;
+#endif
+#endif
+    using ::arena_t;
+    using ::error;
+    using ::arena_err_t;
+    using ::last_error;
+    inline const char *strerror(arena_err_t code) { return ::arena_strerror(code); }
+    using ::init;
+    using ::init_buffer;
+    using ::child;
+    using ::reset;
+    using ::set_retain;
+    using ::trim;
+    using ::add_cleanup;
+    using ::arena_cleanup_fn;
+    using ::set_name;
+    using ::stats;
+    using ::arena_seg_t;
+    using ::seg_init;
+    using ::seg_push;
+    using ::seg_at;
+    using ::seg_segment;
+    using ::memdup;
+    inline char *strdup(arena_t *arena, const char *str) { return ::arena_strdup(arena, str); }
+#ifdef ARENA_STDIO
+    inline char *vsprintf(arena_t *arena, const char *fmt, va_list ap) _ARENA_PRINTF(2, 0);
+    inline char *vsprintf(arena_t *arena, const char *fmt, va_list ap)
+    {
+        return ::arena_vsprintf(arena, fmt, ap);
+    }
+    inline char *sprintf(arena_t *arena, const char *fmt, ...) _ARENA_PRINTF(2, 3);
+    inline char *sprintf(arena_t *arena, const char *fmt, ...)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        char *str = ::arena_vsprintf(arena, fmt, ap);
+        va_end(ap);
+        return str;
+    }
+#endif
+    using ::arena_stats_t;
+    using ::arena_write_fn;
+#ifdef ARENA_REGISTRY
+    using ::dump_stats;
+#endif
+    using ::arena_trace_event_t;
+#ifdef ARENA_TRACE
+    using ::trace_start;
+    using ::trace_flush;
+    using ::trace_stop;
+#ifdef ARENA_POSIX
+    using ::trace_open;
+#endif
+#endif
+    using ::arena_off_t;
+    using ::off;
+    using ::ptr;
+    using ::arena_handle_t;
+    using ::deref;
+    using ::handle;
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+    using ::init_file;
+    using ::init_shared;
+    using ::load;
+    using ::save;
+    inline int sync(arena_t *arena) { return ::arena_sync(arena); }
+#endif
+#ifdef ARENA_POSIX
+    inline long readv(arena_t *arena, int fd, const unsigned long *lens, int count, struct iovec *iov)
+    {
+        return ::arena_readv(arena, fd, lens, count, iov);
+    }
+    inline int iovec(arena_t *arena, arena_mark_t from, struct iovec *iov, int max)
+    {
+        return ::arena_iovec(arena, from, iov, max);
+    }
+#endif
+    using ::arena_mark_t;
+    using ::arena_temp_t;
+    using ::mark;
+    inline void rewind(arena_t *arena, arena_mark_t m) { ::arena_rewind(arena, m); }
+#ifndef ARENA_NOALLOC
+    using ::destroy;
+    using ::transfer;
+    using ::scratch_begin;
+    using ::scratch_end;
+#endif
+}
+#endif /* ARENA_NAMESPACE */
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * C++ Adapters (optional, C++11 or later)
+ * ============================================================================
+ */
+#if defined(__cplusplus) && defined(ARENA_CXX)
+#include <climits>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+namespace arena
+{
+    /* Allocates from the arena or throws std::bad_alloc */
+    inline void *_allocate_or_throw(arena_t *a, std::size_t size, std::size_t alignment)
+    {
+        if (size == 0)
+            size = 1;
+        if (size > (std::size_t)INT_MAX || alignment > (std::size_t)INT_MAX)
+            throw std::bad_alloc();
+
+        void *p = ::_ARENA_PREFIX(alloc_aligned)(a, (int)size, (int)alignment);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    /* ------------------------------------------------------------------------
+     * arena::allocator<T> - stateful allocator for standard containers.
+     * deallocate() is a no-op; memory is reclaimed by arena_reset/destroy.
+     * ------------------------------------------------------------------------
+     */
+    template <typename T>
+    class allocator
+    {
+    public:
+        typedef T value_type;
+
+        explicit allocator(arena_t *a) noexcept : arena_(a) {}
+
+        template <typename U>
+        allocator(const allocator<U> &other) noexcept : arena_(other.get()) {}
+
+        T *allocate(std::size_t n)
+        {
+            if (n > (std::size_t)INT_MAX / sizeof(T))
+                throw std::bad_alloc();
+            return static_cast<T *>(_allocate_or_throw(arena_, n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, std::size_t) noexcept {}
+
+        arena_t *get() const noexcept { return arena_; }
+
+    private:
+        arena_t *arena_;
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept
+    {
+        return a.get() == b.get();
+    }
+
+    template <typename T, typename U>
+    inline bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept
+    {
+        return a.get() != b.get();
+    }
+
+    /* ------------------------------------------------------------------------
+     * arena::make<T>(a, args...) / arena::make_array<T>(a, n) - construct
+     * objects in the arena. Destructors are registered as arena cleanups,
+     * except for trivially destructible types, which pay nothing.
+     * ------------------------------------------------------------------------
+     */
+    template <typename T>
+    void _destroy_one(void *p)
+    {
+        static_cast<T *>(p)->~T();
+    }
+
+    template <typename T>
+    struct _array_cleanup
+    {
+        T *items;
+        std::size_t count;
+
+        static void run(void *p)
+        {
+            _array_cleanup *c = static_cast<_array_cleanup *>(p);
+            for (std::size_t i = c->count; i > 0; i--)
+                c->items[i - 1].~T();
+        }
+    };
+
+    template <typename T>
+    inline void _register(arena_t *, T *, std::true_type) {}
+
+    template <typename T>
+    inline void _register(arena_t *a, T *obj, std::false_type)
+    {
+        if (::_ARENA_PREFIX(add_cleanup)(a, &_destroy_one<T>, obj) != 0)
+        {
+            obj->~T();
+            throw std::bad_alloc();
+        }
+    }
+
+    template <typename T, typename... Args>
+    T *make(arena_t *a, Args &&...args)
+    {
+        void *p = _allocate_or_throw(a, sizeof(T), alignof(T));
+        T *obj = new (p) T(std::forward<Args>(args)...);
+        _register(a, obj, typename std::is_trivially_destructible<T>::type());
+        return obj;
+    }
+
+    template <typename T>
+    T *make_array(arena_t *a, std::size_t n)
+    {
+        if (n > (std::size_t)INT_MAX / sizeof(T))
+            throw std::bad_alloc();
+
+        T *items = static_cast<T *>(_allocate_or_throw(a, n * sizeof(T), alignof(T)));
+        _array_cleanup<T> *cleanup = 0;
+        if (!std::is_trivially_destructible<T>::value)
+            cleanup = static_cast<_array_cleanup<T> *>(
+                _allocate_or_throw(a, sizeof(_array_cleanup<T>), alignof(_array_cleanup<T>)));
+
+        std::size_t i = 0;
+        try
+        {
+            for (; i < n; i++)
+                new (items + i) T();
+        }
+        catch (...)
+        {
+            while (i > 0)
+                items[--i].~T();
+            throw;
+        }
+
+        if (cleanup)
+        {
+            cleanup->items = items;
+            cleanup->count = n;
+            if (::_ARENA_PREFIX(add_cleanup)(a, &_array_cleanup<T>::run, cleanup) != 0)
+            {
+                _array_cleanup<T>::run(cleanup);
+                throw std::bad_alloc();
+            }
+        }
+        return items;
+    }
+
+    /* ------------------------------------------------------------------------
+     * arena::segmented_array<T> - append-only array over an arena_seg_t.
+     * Elements never move, so pointers and references stay valid as it
+     * grows; iteration walks each segment contiguously. The arena_seg_t
+     * lives in the arena, so copies refer to the same array. Destructors
+     * run on arena reset/destroy, newest element first.
+     * ------------------------------------------------------------------------
+     */
+    template <typename T>
+    struct _seg_cleanup
+    {
+        static void run(void *p)
+        {
+            arena_seg_t *seg = static_cast<arena_seg_t *>(p);
+            for (unsigned long i = seg->count; i > 0; i--)
+                static_cast<T *>(::_ARENA_PREFIX(seg_at)(seg, i - 1))->~T();
+        }
+    };
+
+    template <typename T>
+    class segmented_array
+    {
+    public:
+        typedef T value_type;
+        typedef std::size_t size_type;
+
+        template <typename U>
+        class basic_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef U value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef U *pointer;
+            typedef U &reference;
+
+            basic_iterator() noexcept : seg_(0), k_(0), p_(0), last_(0) {}
+            basic_iterator(const arena_seg_t *seg, int k) noexcept : seg_(seg), k_(k), p_(0), last_(0) { load(); }
+
+            U &operator*() const noexcept { return *p_; }
+            U *operator->() const noexcept { return p_; }
+
+            basic_iterator &operator++() noexcept
+            {
+                if (++p_ == last_)
+                {
+                    k_++;
+                    load();
+                }
+                return *this;
+            }
+
+            basic_iterator operator++(int) noexcept
+            {
+                basic_iterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const basic_iterator &other) const noexcept { return p_ == other.p_; }
+            bool operator!=(const basic_iterator &other) const noexcept { return p_ != other.p_; }
+
+        private:
+            void load() noexcept
+            {
+                unsigned long n;
+                p_ = seg_ ? static_cast<U *>(::_ARENA_PREFIX(seg_segment)(seg_, k_, &n)) : 0;
+                last_ = p_ ? p_ + n : 0;
+            }
+
+            const arena_seg_t *seg_;
+            int k_;
+            U *p_;
+            U *last_;
+        };
+
+        typedef basic_iterator<T> iterator;
+        typedef basic_iterator<const T> const_iterator;
+
+        explicit segmented_array(arena_t *a, std::size_t first = 16)
+        {
+            seg_ = static_cast<arena_seg_t *>(_allocate_or_throw(a, sizeof(arena_seg_t), alignof(arena_seg_t)));
+            if (::_ARENA_PREFIX(seg_init)(seg_, a, sizeof(T), alignof(T), (unsigned long)first) != 0)
+                throw std::bad_alloc();
+            if (!std::is_trivially_destructible<T>::value &&
+                ::_ARENA_PREFIX(add_cleanup)(a, &_seg_cleanup<T>::run, seg_) != 0)
+                throw std::bad_alloc();
+        }
+
+        template <typename... Args>
+        T &emplace_back(Args &&...args)
+        {
+            void *p = ::_ARENA_PREFIX(seg_push)(seg_);
+            if (!p)
+                throw std::bad_alloc();
+            try
+            {
+                return *new (p) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                seg_->count--;
+                throw;
+            }
+        }
+
+        T &push_back(const T &value) { return emplace_back(value); }
+        T &push_back(T &&value) { return emplace_back(std::move(value)); }
+
+        T &operator[](std::size_t i) noexcept { return *static_cast<T *>(::_ARENA_PREFIX(seg_at)(seg_, i)); }
+        const T &operator[](std::size_t i) const noexcept
+        {
+            return *static_cast<const T *>(::_ARENA_PREFIX(seg_at)(seg_, i));
+        }
+
+        std::size_t size() const noexcept { return seg_->count; }
+        bool empty() const noexcept { return seg_->count == 0; }
+        arena_seg_t *get() const noexcept { return seg_; }
+
+        iterator begin() noexcept { return iterator(seg_, 0); }
+        iterator end() noexcept { return iterator(); }
+        const_iterator begin() const noexcept { return const_iterator(seg_, 0); }
+        const_iterator end() const noexcept { return const_iterator(); }
+
+    private:
+        arena_seg_t *seg_;
+    };
+
+    /* ------------------------------------------------------------------------
+     * arena::static_arena<N, Align> - arena with N bytes of inline storage.
+     * Lives on the stack, as a member or in .bss; never copied or moved.
+     * Cleanups run when it goes out of scope.
+     * ------------------------------------------------------------------------
+     */
+    template <std::size_t N, std::size_t Align = alignof(std::max_align_t)>
+    class static_arena
+    {
+        static_assert(N > 0, "static_arena needs a non-zero size");
+        static_assert(N <= (std::size_t)INT_MAX, "static_arena size must fit in an int");
+        static_assert(Align > 0 && (Align & (Align - 1)) == 0, "alignment must be power of two");
+
+    public:
+        static_arena() noexcept { ::_ARENA_PREFIX(init_buffer)(&arena_, storage_, (int)N); }
+        ~static_arena() { ::_ARENA_PREFIX(reset)(&arena_); }
+
+        static_arena(const static_arena &) = delete;
+        static_arena &operator=(const static_arena &) = delete;
+
+        arena_t *get() noexcept { return &arena_; }
+        operator arena_t *() noexcept { return &arena_; }
+
+        static constexpr std::size_t capacity() noexcept { return N; }
+        static constexpr std::size_t alignment() noexcept { return Align; }
+
+    private:
+        arena_t arena_;
+        alignas(Align) unsigned char storage_[N];
+    };
+
+#ifndef ARENA_NOALLOC
+    /* ------------------------------------------------------------------------
+     * arena::scratch - RAII scratch arena, rewound when it goes out of scope.
+     *   arena::scratch s({a, b}); // a scratch arena that is neither a nor b
+     * ------------------------------------------------------------------------
+     */
+    class scratch
+    {
+    public:
+        scratch() : temp_(::_ARENA_PREFIX(scratch_begin)(0, 0)) { check(); }
+
+        scratch(std::initializer_list<arena_t *> conflicts)
+            : temp_(::_ARENA_PREFIX(scratch_begin)(conflicts.begin(), (int)conflicts.size()))
+        {
+            check();
+        }
+
+        ~scratch() { ::_ARENA_PREFIX(scratch_end)(temp_); }
+
+        scratch(const scratch &) = delete;
+        scratch &operator=(const scratch &) = delete;
+
+        arena_t *get() const noexcept { return temp_.arena; }
+        operator arena_t *() const noexcept { return temp_.arena; }
+
+    private:
+        void check() const
+        {
+            if (!temp_.arena)
+                throw std::bad_alloc();
+        }
+
+        arena_temp_t temp_;
+    };
+#endif
+
+#if __cplusplus >= 201703L
+    /* ------------------------------------------------------------------------
+     * arena::memory_resource - std::pmr::memory_resource over an arena_t.
+     * Like std::pmr::monotonic_buffer_resource, deallocation is a no-op.
+     * ------------------------------------------------------------------------
+     */
+    class memory_resource : public std::pmr::memory_resource
+    {
+    public:
+        explicit memory_resource(arena_t *a) noexcept : arena_(a) {}
+
+        arena_t *get() const noexcept { return arena_; }
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            return _allocate_or_throw(arena_, bytes, alignment);
+        }
+
+        void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        arena_t *arena_;
+    };
+#endif
+
+#if __cplusplus >= 202002L
+    /* ------------------------------------------------------------------------
+     * arena::current_arena - sets the calling thread's arena for coroutine
+     * frames until it goes out of scope (nests; restores the previous one).
+     * ------------------------------------------------------------------------
+     */
+    inline arena_t *&_current_frame_arena() noexcept
+    {
+        static thread_local arena_t *current = nullptr;
+        return current;
+    }
+
+    class current_arena
+    {
+    public:
+        explicit current_arena(arena_t *a) noexcept : previous_(_current_frame_arena())
+        {
+            _current_frame_arena() = a;
+        }
+        ~current_arena() { _current_frame_arena() = previous_; }
+
+        current_arena(const current_arena &) = delete;
+        current_arena &operator=(const current_arena &) = delete;
+
+        static arena_t *get() noexcept { return _current_frame_arena(); }
+
+    private:
+        arena_t *previous_;
+    };
+
+    /* ------------------------------------------------------------------------
+     * arena::frame_allocator - promise type mixin: coroutine frames come from
+     * the first arena_t * argument, else the current arena, else the heap.
+     *   struct promise_type : arena::frame_allocator { ... };
+     * ------------------------------------------------------------------------
+     */
+    struct _frame_header
+    {
+        arena_t *arena; /* NULL: frame came from the global operator new */
+    };
+
+    constexpr std::size_t _frame_align = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    constexpr std::size_t _frame_header_size = (sizeof(_frame_header) + _frame_align - 1) & ~(_frame_align - 1);
+
+    inline void *_frame_allocate(std::size_t size, arena_t *a)
+    {
+        void *p = nullptr;
+
+        if (a && size <= (std::size_t)INT_MAX - _frame_header_size)
+            p = ::_ARENA_PREFIX(alloc_aligned)(a, (int)(size + _frame_header_size), (int)_frame_align);
+        if (!p)
+        {
+            p = ::operator new(size + _frame_header_size);
+            a = nullptr;
+        }
+        static_cast<_frame_header *>(p)->arena = a;
+        return static_cast<unsigned char *>(p) + _frame_header_size;
+    }
+
+    inline void _frame_free(void *frame) noexcept
+    {
+        void *p = static_cast<unsigned char *>(frame) - _frame_header_size;
+        if (!static_cast<_frame_header *>(p)->arena)
+            ::operator delete(p);
+    }
+
+    inline arena_t *_frame_arena_of(arena_t *a) noexcept { return a; }
+
+    template <typename T>
+    inline arena_t *_frame_arena_of(const T &) noexcept
+    {
+        return nullptr;
+    }
+
+    struct frame_allocator
+    {
+        static void *operator new(std::size_t size) { return _frame_allocate(size, current_arena::get()); }
+
+        template <typename... Args>
+        static void *operator new(std::size_t size, Args &...args)
+        {
+            arena_t *a = nullptr;
+            ((a = a ? a : _frame_arena_of(args)), ...);
+            return _frame_allocate(size, a ? a : current_arena::get());
+        }
+
+        static void operator delete(void *frame, std::size_t) noexcept { _frame_free(frame); }
+    };
+#endif
+} /* namespace arena */
+#endif /* __cplusplus && ARENA_CXX */
+
+#ifdef ARENA_IMPLEMENTATION
+#include <limits.h>
+#ifdef ARENA_STDIO
+#include <stdio.h> /* vsnprintf */
+
+/* va_copy is C99; GCC and Clang also have __va_copy in C89 mode */
+#if defined(va_copy)
+#define _ARENA_VA_COPY(dst, src) va_copy(dst, src)
+#elif defined(__va_copy)
+#define _ARENA_VA_COPY(dst, src) __va_copy(dst, src)
+#else
+#error "ARENA_STDIO needs va_copy (C99) or __va_copy"
+#endif
+#endif
+#if !defined(__GNUC__) && !defined(__clang__)
+#include <stdlib.h> /* abort, for ARENA_ABORT */
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef ARENA_POSIX
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/* ============================================================================
+ * Arena flags (internal)
+ * ============================================================================
+ */
+#define _ARENA_FLAG_READONLY 0x1u /* Contents may not change */
+#define _ARENA_FLAG_MAPPED 0x2u   /* data lives in an mmap() after a file header */
+#define _ARENA_FLAG_FILE 0x4u     /* MAP_SHARED file; pos is persisted in the header */
+#define _ARENA_FLAG_SHARED 0x8u   /* Cross-process; the header pos is the real pos */
+#define _ARENA_FLAG_BORROWED 0x10u /* arena_t and data belong to the caller */
+#define _ARENA_FLAG_REALTIME 0x20u /* Pre-faulted and mlock()ed; no syscalls */
+#define _ARENA_FLAG_CHILD 0x40u    /* Carved from arena->parent */
+#define _ARENA_FLAG_HEAP 0x80u     /* data is a heap block (struct _arena_block) */
+#define _ARENA_FLAG_IN_OVERFLOW 0x100u /* on_overflow is running in some thread */
+#define _ARENA_FLAG_OVERFLOW_FAILED 0x200u /* Its last run made no room */
+
+/* Arenas with any of these flags allocate through _arena_alloc_slow */
+#define _ARENA_FLAGS_SLOW (_ARENA_FLAG_SHARED | _ARENA_FLAG_CHILD)
+
+/* ============================================================================
+ * Heap blocks - ARENA_MALLOC'd memory with a header ahead of the data.
+ * The current block is described by arena->data/capacity/pos; older ones
+ * hang off arena->blocks, newest first, with their final pos stored.
+ * ============================================================================
+ */
+struct _arena_block
+{
+    struct _arena_block *prev; /* Next older block */
+    unsigned long capacity;    /* Data bytes after the header */
+    unsigned long pos;         /* Bytes used, once the block is retired */
+#ifdef ARENA_BLOCK_CACHE
+    int size_class;            /* Cache class, -1 if too large to cache */
+#endif
+};
+
+#define _ARENA_BLOCK_HEADER ((sizeof(struct _arena_block) + 15UL) & ~15UL)
+#define _ARENA_BLOCK(data) ((struct _arena_block *)((unsigned char *)(data) - _ARENA_BLOCK_HEADER))
+#define _ARENA_BLOCK_DATA(block) ((unsigned char *)(block) + _ARENA_BLOCK_HEADER)
+
+/* Large object allocated outside the blocks; data follows, aligned */
+struct _arena_large
+{
+    struct _arena_large *next; /* Next older large object */
+    unsigned long size;        /* Bytes requested */
+};
+
+#define _ARENA_LARGE_HEADER ((sizeof(struct _arena_large) + 15UL) & ~15UL)
+
+/* ============================================================================
+ * Atomics (GCC/Clang builtins), used where arenas are shared lock-free
+ * ============================================================================
+ */
+#define _ARENA_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define _ARENA_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define _ARENA_ATOMIC_CAS(p, expected, desired) \
+    __atomic_compare_exchange_n((p), (expected), (desired), 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/* Gives up the CPU while waiting for another thread */
+#ifdef ARENA_POSIX
+#define _ARENA_YIELD() sched_yield()
+#else
+#define _ARENA_YIELD() ((void)0)
+#endif
+
+/* ============================================================================
+ * File header - precedes the data of image and file-backed arenas
+ * ============================================================================
+ */
+#define ARENA_FILE_MAGIC (0x414e5241UL + (unsigned long)sizeof(unsigned long)) /* "ARNA" */
+#define ARENA_FILE_VERSION 1UL
+
+typedef struct _arena_file_header
+{
+    unsigned long magic;    /* ARENA_FILE_MAGIC, also catches sizeof(long) mismatches */
+    unsigned long version;  /* ARENA_FILE_VERSION */
+    unsigned long capacity; /* Bytes of arena data following the header */
+    unsigned long pos;      /* Bytes in use */
+} _arena_file_header;
+
+/* ============================================================================
+ * _arena_pos - the arena's current pos. Shared arenas keep the real one in
+ * their header; arena->pos is not updated when they allocate.
+ * ============================================================================
+ */
+static unsigned long _arena_pos(const arena_t *arena)
+{
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+    if (arena->flags & _ARENA_FLAG_SHARED)
+        return _ARENA_ATOMIC_LOAD(&((_arena_file_header *)(arena->data - ARENA_FILE_HEADER_SIZE))->pos);
+#endif
+    return arena->pos;
+}
+
+/* ============================================================================
+ * _arena_note_usage - folds the bytes in use (all blocks and large objects)
+ * into arena->high_water; called before anything is freed.
+ * Caller must hold ARENA_LOCK().
+ * ============================================================================
+ */
+static void _arena_note_usage(arena_t *arena)
+{
+    const struct _arena_large *large;
+    const struct _arena_block *b;
+    unsigned long used = _arena_pos(arena);
+
+    for (b = arena->blocks; b; b = b->prev)
+        used += b->pos;
+    for (large = arena->large; large; large = large->next)
+        used += large->size;
+    if (used > arena->high_water)
+        arena->high_water = used;
+}
+
+/* ============================================================================
+ * Last error of the calling thread; written only when a call fails
+ * ============================================================================
+ */
+static ARENA_TLS arena_err_t _arena_last_error = ARENA_OK;
+
+/* Records code as the arena's and the thread's last error */
+#define _ARENA_FAIL(arena, code) ((arena)->error = (code), _arena_last_error = (code))
+
+/* ============================================================================
+ * arena_strerror - message for an error code
+ * ============================================================================
+ */
+const char *arena_strerror(arena_err_t code)
+{
+    switch (code)
+    {
+    case ARENA_OK:
+        return "no error";
+    case ARENA_E_NULL:
+        return "null argument";
+    case ARENA_E_SIZE:
+        return "invalid size";
+    case ARENA_E_ALIGN:
+        return "alignment must be power of two";
+    case ARENA_E_OVERFLOW:
+        return "arena overflow";
+    case ARENA_E_NOMEM:
+        return "out of memory";
+    case ARENA_E_READONLY:
+        return "arena is read-only";
+    case ARENA_E_MARK:
+        return "invalid mark";
+    case ARENA_E_PARENT_RESET:
+        return "parent arena was reset or rewound";
+    case ARENA_E_UNSUPPORTED:
+        return "not supported by this arena";
+    case ARENA_E_STATE:
+        return "invalid state for this call";
+    case ARENA_E_CONFLICT:
+        return "all scratch arenas conflict";
+    case ARENA_E_ARGUMENT:
+        return "invalid argument";
+    case ARENA_E_IO:
+        return "system call failed";
+    case ARENA_E_FORMAT:
+        return "invalid file format";
+    }
+    return "unknown error";
+}
+
+/* ============================================================================
+ * arena_last_error - the calling thread's last error code
+ * ============================================================================
+ */
+arena_err_t _ARENA_PREFIX(last_error)(void)
+{
+    return _arena_last_error;
+}
+
+/* ============================================================================
+ * arena_error - message for the last failure on arena, or of the calling
+ * thread if arena is NULL
+ * ============================================================================
+ */
+const char *_ARENA_PREFIX(error)(arena_t *arena)
+{
+    return arena_strerror(arena ? arena->error : _arena_last_error);
+}
+
+/* ============================================================================
+ * Static Arena (if NOALLOC is enabled)
+ * ============================================================================
+ */
+#ifdef ARENA_NOALLOC
+#ifndef ARENA_SIZE
+#error "ARENA_SIZE must be defined when using ARENA_NOALLOC"
+#endif
+
+static unsigned char _arena_static_data[ARENA_SIZE];
+static arena_t _arena_static;
+static int _arena_static_used = 0;
+#endif
+
+#ifdef ARENA_TRACE
+/* ============================================================================
+ * Tracing - records go to a per-thread buffer, flushed to the sink set by
+ * arena_trace_start. Flushes are serialized by a spin flag rather than
+ * ARENA_LOCK, since records are made with ARENA_LOCK held.
+ * ============================================================================
+ */
+#ifndef ARENA_TRACE_CLOCK
+#ifdef ARENA_POSIX
+#define ARENA_TRACE_CLOCK() _arena_trace_clock()
+
+static unsigned long _arena_trace_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+#else
+#define ARENA_TRACE_CLOCK() 0UL
+#endif
+#endif
+
+struct _arena_trace_buffer
+{
+    unsigned long count;
+    arena_trace_event_t events[ARENA_TRACE_EVENTS];
+};
+
+static ARENA_TLS struct _arena_trace_buffer _arena_trace_buf;
+static arena_write_fn _arena_trace_write;
+static void *_arena_trace_ctx;
+static int _arena_trace_busy;
+static unsigned long _arena_trace_next_id;
+
+static void _arena_trace_flush_buffer(struct _arena_trace_buffer *buf)
+{
+    int expected = 0;
+
+    if (!buf->count)
+        return;
+
+    while (!_ARENA_ATOMIC_CAS(&_arena_trace_busy, &expected, 1))
+        expected = 0;
+    if (_arena_trace_write)
+        _arena_trace_write(_arena_trace_ctx, (const char *)buf->events,
+                           buf->count * sizeof(arena_trace_event_t));
+    _ARENA_ATOMIC_STORE(&_arena_trace_busy, 0);
+    buf->count = 0;
+}
+
+#ifdef ARENA_POSIX
+static pthread_key_t _arena_trace_key;
+static pthread_once_t _arena_trace_once = PTHREAD_ONCE_INIT;
+
+static void _arena_trace_teardown(void *buf)
+{
+    _arena_trace_flush_buffer((struct _arena_trace_buffer *)buf);
+}
+
+static void _arena_trace_make_key(void)
+{
+    pthread_key_create(&_arena_trace_key, _arena_trace_teardown);
+}
+#endif
+
+static void _arena_trace(const arena_t *arena, unsigned long type, unsigned long size,
+                         unsigned long alignment)
+{
+    struct _arena_trace_buffer *buf = &_arena_trace_buf;
+    arena_trace_event_t *ev;
+
+    if (!_ARENA_ATOMIC_LOAD(&_arena_trace_write))
+        return;
+
+#ifdef ARENA_POSIX
+    if (buf->count == 0)
+    {
+        pthread_once(&_arena_trace_once, _arena_trace_make_key);
+        pthread_setspecific(_arena_trace_key, buf);
+    }
+#endif
+
+    ev = &buf->events[buf->count++];
+    ev->time_ns = ARENA_TRACE_CLOCK();
+    ev->arena = arena->id;
+    ev->type = type;
+    ev->size = size;
+    ev->alignment = alignment;
+
+    if (buf->count == ARENA_TRACE_EVENTS)
+        _arena_trace_flush_buffer(buf);
+}
+
+#define _ARENA_TRACE(arena, type, size, alignment) \
+    _arena_trace((arena), (type), (unsigned long)(size), (unsigned long)(alignment))
+#else
+#define _ARENA_TRACE(arena, type, size, alignment) ((void)0)
+#endif
+
+/* ============================================================================
+ * _arena_setup - fills in every arena_t field for a fresh arena
+ * ============================================================================
+ */
+static void _arena_setup(arena_t *arena, unsigned char *data, unsigned long capacity,
+                         unsigned long pos, unsigned int flags)
+{
+    arena->data = data;
+    arena->capacity = capacity;
+    arena->pos = pos;
+    arena->error = ARENA_OK;
+    arena->peak = pos;
+    arena->high_water = pos;
+    arena->retain = ~0UL;
+    arena->cleanups = NULL;
+    arena->flags = flags;
+    arena->generation = 0;
+    arena->parent = NULL;
+    arena->parent_gen = 0;
+    arena->blocks = NULL;
+    arena->name = NULL;
+    arena->on_overflow = NULL;
+    arena->overflow_ctx = NULL;
+    arena->large = NULL;
+    arena->large_threshold = ~0UL;
+    arena->reserved = NULL;
+    arena->reserved_len = 0;
+#ifdef ARENA_TRACE
+    arena->id = __atomic_add_fetch(&_arena_trace_next_id, 1UL, __ATOMIC_RELAXED);
+    _ARENA_TRACE(arena, ARENA_TRACE_INIT, capacity, 0);
+#else
+    arena->id = 0;
+#endif
+}
+
+#ifdef ARENA_REGISTRY
+/* ============================================================================
+ * Registry - live arenas in a fixed slot array. Slots are claimed and
+ * released with a CAS, so arenas join and leave without ARENA_LOCK.
+ * ============================================================================
+ */
+static arena_t *_arena_registry[ARENA_REGISTRY_SLOTS];
+static unsigned long _arena_registry_untracked;
+
+static void _arena_register(arena_t *arena)
+{
+    int i;
+
+    for (i = 0; i < ARENA_REGISTRY_SLOTS; i++)
+    {
+        arena_t *expected = NULL;
+        if (!_ARENA_ATOMIC_LOAD(&_arena_registry[i]) &&
+            _ARENA_ATOMIC_CAS(&_arena_registry[i], &expected, arena))
+            return;
+    }
+    __atomic_fetch_add(&_arena_registry_untracked, 1UL, __ATOMIC_RELAXED);
+}
+
+#ifndef ARENA_NOALLOC
+static void _arena_unregister(arena_t *arena)
+{
+    int i;
+
+    for (i = 0; i < ARENA_REGISTRY_SLOTS; i++)
+    {
+        arena_t *expected = arena;
+        if (_ARENA_ATOMIC_CAS(&_arena_registry[i], &expected, (arena_t *)NULL))
+            return;
+    }
+    __atomic_fetch_sub(&_arena_registry_untracked, 1UL, __ATOMIC_RELAXED);
+}
+#endif
+#else
+#define _arena_register(arena) ((void)0)
+#define _arena_unregister(arena) ((void)0)
+#endif
+
+/* ============================================================================
+ * _arena_find_mark - checks that mark lies in arena. Returns 1 if it is in
+ * the current block, 2 if in an older block (stored in *block), else 0.
+ * Caller must hold ARENA_LOCK().
+ * ============================================================================
+ */
+static int _arena_find_mark(arena_t *arena, arena_mark_t mark, struct _arena_block **block)
+{
+    struct _arena_block *b;
+
+    if (mark.data == arena->data)
+        return mark.pos <= _arena_pos(arena) ? 1 : 0;
+
+    for (b = arena->blocks; b; b = b->prev)
+    {
+        if (_ARENA_BLOCK_DATA(b) == mark.data)
+        {
+            *block = b;
+            return mark.pos <= b->pos ? 2 : 0;
+        }
+    }
+    return 0;
+}
+
+#ifndef ARENA_NOALLOC
+#ifdef ARENA_BLOCK_CACHE
+/* ============================================================================
+ * Block cache - per size class, a slot array of free blocks; arena structs
+ * have a class of their own. Slots are filled with a CAS on NULL and
+ * emptied with an atomic exchange, so no lock is taken and a block can
+ * only ever be handed to one taker.
+ * ============================================================================
+ */
+static void *_arena_cache_blocks[ARENA_BLOCK_CACHE_CLASSES][ARENA_BLOCK_CACHE_SLOTS];
+static void *_arena_cache_arenas[ARENA_BLOCK_CACHE_SLOTS];
+static unsigned long _arena_cache_bytes; /* Bytes held in all slots */
+
+/* Smallest class whose capacity holds capacity bytes, or -1 */
+static int _arena_cache_class(unsigned long capacity)
+{
+    int size_class;
+
+    for (size_class = 0; size_class < ARENA_BLOCK_CACHE_CLASSES; size_class++)
+        if (capacity <= 1UL << (ARENA_BLOCK_CACHE_MIN_SHIFT + size_class))
+            return size_class;
+    return -1;
+}
+
+static void *_arena_cache_get(void **slots, unsigned long bytes)
+{
+    int i;
+
+    for (i = 0; i < ARENA_BLOCK_CACHE_SLOTS; i++)
+    {
+        void *ptr;
+
+        if (!_ARENA_ATOMIC_LOAD(&slots[i]))
+            continue;
+        ptr = __atomic_exchange_n(&slots[i], (void *)NULL, __ATOMIC_ACQ_REL);
+        if (ptr)
+        {
+            __atomic_fetch_sub(&_arena_cache_bytes, bytes, __ATOMIC_RELAXED);
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/* Returns 1 if ptr was cached, 0 if the caller should free it */
+static int _arena_cache_put(void **slots, void *ptr, unsigned long bytes)
+{
+    int i;
+
+    if (__atomic_add_fetch(&_arena_cache_bytes, bytes, __ATOMIC_RELAXED) <= ARENA_BLOCK_CACHE_BUDGET)
+    {
+        for (i = 0; i < ARENA_BLOCK_CACHE_SLOTS; i++)
+        {
+            void *expected = NULL;
+            if (!_ARENA_ATOMIC_LOAD(&slots[i]) && _ARENA_ATOMIC_CAS(&slots[i], &expected, ptr))
+                return 1;
+        }
+    }
+    __atomic_fetch_sub(&_arena_cache_bytes, bytes, __ATOMIC_RELAXED);
+    return 0;
+}
+#endif
+
+/* ============================================================================
+ * _arena_block_new / _arena_block_free - heap block allocation
+ * ============================================================================
+ */
+static struct _arena_block *_arena_block_new(unsigned long capacity)
+{
+    struct _arena_block *block;
+    unsigned long size = capacity;
+#ifdef ARENA_BLOCK_CACHE
+    int size_class = _arena_cache_class(capacity);
+
+    block = NULL;
+    if (size_class >= 0)
+    {
+        size = 1UL << (ARENA_BLOCK_CACHE_MIN_SHIFT + size_class);
+        block = (struct _arena_block *)_arena_cache_get(_arena_cache_blocks[size_class],
+                                                        _ARENA_BLOCK_HEADER + size);
+    }
+    if (!block)
+#endif
+    {
+        if (size > ~0UL - _ARENA_BLOCK_HEADER)
+            return NULL;
+
+        block = (struct _arena_block *)ARENA_MALLOC(_ARENA_BLOCK_HEADER + size);
+        if (!block)
+            return NULL;
+    }
+
+    block->prev = NULL;
+    block->capacity = capacity;
+    block->pos = 0;
+#ifdef ARENA_BLOCK_CACHE
+    block->size_class = size_class;
+#endif
+    return block;
+}
+
+static void _arena_block_free(struct _arena_block *block)
+{
+#ifdef ARENA_BLOCK_CACHE
+    int size_class = block->size_class;
+
+    if (size_class >= 0 &&
+        _arena_cache_put(_arena_cache_blocks[size_class], block,
+                         _ARENA_BLOCK_HEADER + (1UL << (ARENA_BLOCK_CACHE_MIN_SHIFT + size_class))))
+        return;
+#endif
+    ARENA_FREE(block);
+}
+
+/* ============================================================================
+ * _arena_struct_new / _arena_struct_free - arena_t allocation
+ * ============================================================================
+ */
+static arena_t *_arena_struct_new(void)
+{
+#ifdef ARENA_BLOCK_CACHE
+    void *arena = _arena_cache_get(_arena_cache_arenas, sizeof(arena_t));
+    if (arena)
+        return (arena_t *)arena;
+#endif
+    return (arena_t *)ARENA_MALLOC(sizeof(arena_t));
+}
+
+static void _arena_struct_free(arena_t *arena)
+{
+#ifdef ARENA_BLOCK_CACHE
+    if (_arena_cache_put(_arena_cache_arenas, arena, sizeof(arena_t)))
+        return;
+#endif
+    ARENA_FREE(arena);
+}
+
+/* ============================================================================
+ * _arena_free_blocks - frees older blocks newer than stop (all if NULL)
+ * Caller must hold ARENA_LOCK().
+ * ============================================================================
+ */
+static void _arena_free_blocks(arena_t *arena, struct _arena_block *stop)
+{
+    while (arena->blocks && arena->blocks != stop)
+    {
+        struct _arena_block *block = arena->blocks;
+        arena->blocks = block->prev;
+        _arena_block_free(block);
+    }
+}
+
+/* ============================================================================
+ * _arena_free_large - frees large objects newer than stop (all if NULL)
+ * Caller must hold ARENA_LOCK().
+ * ============================================================================
+ */
+static void _arena_free_large(arena_t *arena, struct _arena_large *stop)
+{
+    while (arena->large && arena->large != stop)
+    {
+        struct _arena_large *large = arena->large;
+        arena->large = large->next;
+        ARENA_FREE(large);
+    }
+}
+#endif
+
+/* ============================================================================
+ * arena_init
+ * ============================================================================
+ */
+#ifdef ARENA_NOALLOC
+arena_t *_ARENA_PREFIX(init)(void)
+{
+    ARENA_LOCK();
+
+    if (_arena_static_used)
+    {
+        _ARENA_FAIL(&_arena_static, ARENA_E_STATE);
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    _arena_setup(&_arena_static, _arena_static_data, ARENA_SIZE, 0, 0);
+    _arena_register(&_arena_static);
+    _arena_static_used = 1;
+
+    ARENA_UNLOCK();
+    return &_arena_static;
+}
+#else
+arena_t *_ARENA_PREFIX(init)(int size)
+{
+    struct _arena_block *block;
+    arena_t *arena;
+
+    ARENA_LOCK();
+
+    arena = _arena_struct_new();
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NOMEM;
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    block = size > 0 ? _arena_block_new(size) : NULL;
+    if (!block)
+    {
+        _arena_struct_free(arena);
+        _arena_last_error = ARENA_E_NOMEM;
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    _arena_setup(arena, _ARENA_BLOCK_DATA(block), size, 0, _ARENA_FLAG_HEAP);
+    _arena_register(arena);
+
+    ARENA_UNLOCK();
+    return arena;
+}
+#endif
+
+/* ============================================================================
+ * arena_init_buffer - sets up *arena over caller-provided memory
+ * Nothing is allocated; arena_destroy only runs cleanups on such arenas.
+ * ============================================================================
+ */
+arena_t *_ARENA_PREFIX(init_buffer)(arena_t *arena, void *buffer, int size)
+{
+    if (!arena || !buffer || size <= 0)
+    {
+        _arena_last_error = ARENA_E_ARGUMENT;
+        return NULL;
+    }
+
+    _arena_setup(arena, (unsigned char *)buffer, size, 0, _ARENA_FLAG_BORROWED);
+    return arena;
+}
+
+static void *_arena_bump(arena_t *arena, unsigned long size, unsigned long alignment);
+
+/* ============================================================================
+ * arena_child - sets up *child over size bytes carved from parent
+ * The child is reset independently, but arena_reset(parent) invalidates it,
+ * and so does rewinding the parent (e.g. arena_scratch_end) to before it:
+ * further allocations fail with ARENA_E_PARENT_RESET. A rewind is only seen
+ * until the parent allocates past the child again, so end the child first.
+ * Reset or destroy the child before its parent so that its cleanups run.
+ * ============================================================================
+ */
+arena_t *_ARENA_PREFIX(child)(arena_t *child, arena_t *parent, int size)
+{
+    void *data;
+
+    if (!child || !parent)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    if (size <= 0)
+    {
+        _ARENA_FAIL(parent, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    /* In place, never as a large object: the child must lie in a block */
+    _ARENA_TRACE(parent, ARENA_TRACE_ALLOC_ALIGNED, size, 16);
+    data = _arena_bump(parent, (unsigned long)size, 16);
+    if (!data)
+        return NULL;
+
+    _arena_setup(child, (unsigned char *)data, size, 0, _ARENA_FLAG_BORROWED | _ARENA_FLAG_CHILD);
+    child->parent = parent;
+    child->parent_gen = parent->generation;
+    return child;
+}
+
+/* ============================================================================
+ * _arena_child_live - 1 while a child's memory still lies below its parent's
+ * pos, i.e. the parent was neither reset nor rewound past it, else 0.
+ * Caller must hold ARENA_LOCK().
+ * ============================================================================
+ */
+static int _arena_child_live(const arena_t *child)
+{
+    const arena_t *parent = child->parent;
+    const unsigned char *end = child->data + child->capacity;
+    const struct _arena_block *b;
+
+    if (parent->generation != child->parent_gen)
+        return 0;
+    if (child->data >= parent->data && end <= parent->data + _arena_pos(parent))
+        return 1;
+    for (b = parent->blocks; b; b = b->prev)
+        if (child->data >= _ARENA_BLOCK_DATA(b) && end <= _ARENA_BLOCK_DATA(b) + b->pos)
+            return 1;
+    return 0;
+}
+
+
+/* ============================================================================
+ * _arena_overflow - runs the overflow handler for an allocation that did
+ * not fit and retries it once. With avail not NULL the retry is
+ * arena_reserve(arena, size, avail). While one thread runs the handler,
+ * others that overflow wait for it and retry; if that fails they run it
+ * themselves. A thread goes round again only when its retry failed because
+ * other threads took the room: pos, block or capacity moved between the
+ * handler and the retry, or the handler changed them and its block holds
+ * the request but was filled before the retry.
+ * Caller must not hold ARENA_LOCK().
+ * Allocations made by the handler, and the retries, never re-enter it; the
+ * thread's running handlers are kept in a list of stack frames.
+ * ============================================================================
+ */
+struct _arena_overflow_frame
+{
+    arena_t *arena;
+    struct _arena_overflow_frame *prev;
+};
+
+static ARENA_TLS struct _arena_overflow_frame *_arena_overflow_top;
+
+static void *_arena_overflow(arena_t *arena, unsigned long size, unsigned long alignment,
+                             unsigned long *avail)
+{
+    struct _arena_overflow_frame frame, *f;
+    arena_overflow_fn fn;
+    unsigned char *data = NULL, *data0 = NULL;
+    unsigned long pos = 0, capacity = 0, pos0 = 0, capacity0 = 0;
+    void *ptr = NULL;
+    int ok, waited, moved;
+
+    for (f = _arena_overflow_top; f; f = f->prev)
+        if (f->arena == arena)
+            return NULL;
+
+    frame.arena = arena;
+    frame.prev = _arena_overflow_top;
+
+    for (;;)
+    {
+        ARENA_LOCK();
+        fn = arena->on_overflow;
+        if (!fn)
+        {
+            ARENA_UNLOCK();
+            return NULL;
+        }
+        waited = (arena->flags & _ARENA_FLAG_IN_OVERFLOW) != 0;
+        while (arena->flags & _ARENA_FLAG_IN_OVERFLOW)
+        {
+            ARENA_UNLOCK();
+            _ARENA_YIELD();
+            ARENA_LOCK();
+        }
+        if (waited && (arena->flags & _ARENA_FLAG_OVERFLOW_FAILED))
+        {
+            ARENA_UNLOCK();
+            return NULL;
+        }
+        if (!waited)
+            arena->flags |= _ARENA_FLAG_IN_OVERFLOW;
+        data0 = arena->data;
+        pos0 = _arena_pos(arena);
+        capacity0 = arena->capacity;
+        ARENA_UNLOCK();
+
+        _arena_overflow_top = &frame;
+        ok = waited || fn(arena, size, alignment, arena->overflow_ctx);
+        if (ok)
+        {
+            ARENA_LOCK();
+            data = arena->data;
+            pos = _arena_pos(arena);
+            capacity = arena->capacity;
+            ARENA_UNLOCK();
+            ptr = avail ? _ARENA_PREFIX(reserve)(arena, size, avail) : _arena_bump(arena, size, alignment);
+        }
+        _arena_overflow_top = frame.prev;
+
+        if (!waited)
+        {
+            ARENA_LOCK();
+            arena->flags &= ~(_ARENA_FLAG_IN_OVERFLOW | _ARENA_FLAG_OVERFLOW_FAILED);
+            if (!ok)
+                arena->flags |= _ARENA_FLAG_OVERFLOW_FAILED;
+            ARENA_UNLOCK();
+        }
+
+        if (ptr || !ok || _arena_last_error != ARENA_E_OVERFLOW)
+            return ptr;
+
+        ARENA_LOCK();
+        moved = data != arena->data || pos != _arena_pos(arena) || capacity != arena->capacity ||
+                ((data != data0 || pos != pos0 || capacity != capacity0) && size <= capacity &&
+                 alignment - 1 <= capacity - size);
+        if (!waited && !moved)
+        {
+            /* The handler did not make enough room: one retry only */
+            _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+            ARENA_UNLOCK();
+            return NULL;
+        }
+        ARENA_UNLOCK();
+    }
+}
+
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+/* ============================================================================
+ * _arena_alloc_shared - lock-free bump on the pos kept in shared memory
+ * ============================================================================
+ */
+static void *_arena_alloc_shared(arena_t *arena, unsigned long size, unsigned long alignment)
+{
+    _arena_file_header *h = (_arena_file_header *)(arena->data - ARENA_FILE_HEADER_SIZE);
+    unsigned long pos = _ARENA_ATOMIC_LOAD(&h->pos);
+    unsigned long start;
+
+    do
+    {
+        unsigned long addr = (unsigned long)(arena->data + pos);
+        start = pos + (alignment - (addr % alignment)) % alignment;
+        if (start > arena->capacity || size > arena->capacity - start)
+        {
+            _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+            return _arena_overflow(arena, size, alignment, NULL);
+        }
+    } while (!_ARENA_ATOMIC_CAS(&h->pos, &pos, start + size));
+
+    return arena->data + start;
+}
+#endif
+
+/* ============================================================================
+ * _arena_alloc_slow - allocation for arenas flagged _ARENA_FLAGS_SLOW
+ * Shared arenas bump lock-free; children check that their parent has not
+ * been reset or rewound past them and grow in place while they are the
+ * parent's newest block.
+ * ============================================================================
+ */
+static void *_arena_alloc_slow(arena_t *arena, unsigned long size, unsigned long alignment)
+{
+    unsigned long addr, new_pos;
+    arena_t *parent;
+    void *ptr;
+
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+    if (arena->flags & _ARENA_FLAG_SHARED)
+        return _arena_alloc_shared(arena, size, alignment);
+#endif
+
+    ARENA_LOCK();
+
+    parent = arena->parent;
+    if (!_arena_child_live(arena))
+    {
+        _ARENA_FAIL(arena, ARENA_E_PARENT_RESET);
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    addr = (unsigned long)(arena->data + arena->pos);
+    new_pos = arena->pos + (alignment - (addr % alignment)) % alignment;
+
+    if (new_pos > arena->capacity || size > arena->capacity - new_pos)
+    {
+        unsigned long extra = new_pos + size - arena->capacity;
+
+        if (arena->data + arena->capacity != parent->data + parent->pos ||
+            (parent->flags & (_ARENA_FLAG_SHARED | _ARENA_FLAG_READONLY)) ||
+            extra > parent->capacity - parent->pos)
+        {
+            _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+            ARENA_UNLOCK();
+            return _arena_overflow(arena, size, alignment, NULL);
+        }
+        parent->pos += extra;
+        arena->capacity += extra;
+    }
+
+    ptr = arena->data + new_pos;
+    arena->pos = new_pos + size;
+
+    ARENA_UNLOCK();
+    return ptr;
+}
+
+/* ============================================================================
+ * _arena_bump - allocation after arguments are checked, for any arena
+ * ============================================================================
+ */
+static void *_arena_bump(arena_t *arena, unsigned long size, unsigned long alignment)
+{
+    unsigned long addr, new_pos;
+    void *ptr;
+
+    if (arena->flags & _ARENA_FLAGS_SLOW)
+        return _arena_alloc_slow(arena, size, alignment);
+
+    ARENA_LOCK();
+
+    addr = (unsigned long)(arena->data + arena->pos);
+    new_pos = arena->pos + (alignment - (addr % alignment)) % alignment;
+
+    if (new_pos > arena->capacity || size > arena->capacity - new_pos)
+    {
+        _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+        ARENA_UNLOCK();
+        return _arena_overflow(arena, size, alignment, NULL);
+    }
+
+    ptr = arena->data + new_pos;
+    arena->pos = new_pos + size;
+
+    ARENA_UNLOCK();
+    return ptr;
+}
+
+#ifndef ARENA_NOALLOC
+/* ============================================================================
+ * _arena_alloc_large - gives an allocation above large_threshold its own
+ * ARENA_MALLOC block on arena->large. Real-time arenas allocate in place.
+ * ============================================================================
+ */
+static void *_arena_alloc_large(arena_t *arena, unsigned long size, unsigned long alignment)
+{
+    struct _arena_large *large;
+    unsigned long addr, extra = alignment > 16 ? alignment - 1 : 0;
+
+    if (arena->flags & _ARENA_FLAG_REALTIME)
+        return _arena_bump(arena, size, alignment);
+
+    if (size > ~0UL - _ARENA_LARGE_HEADER - extra)
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    large = (struct _arena_large *)ARENA_MALLOC(_ARENA_LARGE_HEADER + extra + size);
+    if (!large)
+    {
+        _ARENA_FAIL(arena, ARENA_E_NOMEM);
+        return NULL;
+    }
+    large->size = size;
+
+    addr = (unsigned long)large + _ARENA_LARGE_HEADER;
+    addr += (alignment - addr % alignment) % alignment;
+
+    ARENA_LOCK();
+    large->next = arena->large;
+    arena->large = large;
+    ARENA_UNLOCK();
+
+    return (void *)addr;
+}
+#endif
+
+/* ============================================================================
+ * arena_alloc
+ * Allocates memory without alignment guarantees.
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(alloc)(arena_t *arena, int size)
+{
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    _ARENA_TRACE(arena, ARENA_TRACE_ALLOC, size, 0);
+
+    if (size <= 0)
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+#ifndef ARENA_NOALLOC
+    if ((unsigned long)size > arena->large_threshold)
+        return _arena_alloc_large(arena, (unsigned long)size, 1);
+#endif
+
+    if (arena->flags & _ARENA_FLAGS_SLOW)
+        return _arena_alloc_slow(arena, size, 1);
+
+    ARENA_LOCK();
+
+    if (arena->pos + (unsigned long)size > arena->capacity)
+    {
+        _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+        ARENA_UNLOCK();
+        return _arena_overflow(arena, (unsigned long)size, 1, NULL);
+    }
+
+    void *ptr = arena->data + arena->pos;
+    arena->pos += size;
+
+    ARENA_UNLOCK();
+    return ptr;
+}
+
+/* ============================================================================
+ * arena_alloc_aligned
+ * Allocates memory with specified alignment (must be power of two).
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(alloc_aligned)(arena_t *arena, int size, int alignment)
+{
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    _ARENA_TRACE(arena, ARENA_TRACE_ALLOC_ALIGNED, size, alignment);
+
+    if (size <= 0)
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    if (alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    {
+        _ARENA_FAIL(arena, ARENA_E_ALIGN);
+        return NULL;
+    }
+
+#ifndef ARENA_NOALLOC
+    if ((unsigned long)size > arena->large_threshold)
+        return _arena_alloc_large(arena, (unsigned long)size, (unsigned long)alignment);
+#endif
+
+    if (arena->flags & _ARENA_FLAGS_SLOW)
+        return _arena_alloc_slow(arena, size, alignment);
+
+    ARENA_LOCK();
+
+    unsigned long current_addr = (unsigned long)(arena->data + arena->pos);
+    unsigned long offset = (alignment - (current_addr % alignment)) % alignment;
+    unsigned long new_pos = arena->pos + offset;
+
+    if (new_pos + (unsigned long)size > arena->capacity)
+    {
+        _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+        ARENA_UNLOCK();
+        return _arena_overflow(arena, (unsigned long)size, (unsigned long)alignment, NULL);
+    }
+
+    void *ptr = arena->data + new_pos;
+    arena->pos = new_pos + size;
+
+    ARENA_UNLOCK();
+    return ptr;
+}
+
+/* ============================================================================
+ * _arena_new - storage for count objects of size bytes, behind ARENA_NEW
+ * ============================================================================
+ */
+void *_arena_new(arena_t *arena, unsigned long count, unsigned long size, unsigned long alignment)
+{
+    if (arena && count > (unsigned long)INT_MAX / size)
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    return _ARENA_PREFIX(alloc_aligned)(arena, (int)(count * size), (int)alignment);
+}
+
+/* ============================================================================
+ * arena_alloc_io - I/O buffer aligned to ARENA_IO_ALIGN, with its length
+ * rounded up to a multiple of it (as O_DIRECT requires). The padded length
+ * is stored in *padded when padded is not NULL.
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(alloc_io)(arena_t *arena, unsigned long size, unsigned long *padded)
+{
+    unsigned long current_addr, new_pos;
+    void *ptr;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    if (size == 0 || size > ~0UL - ARENA_IO_ALIGN)
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+    size = (size + ARENA_IO_ALIGN - 1) & ~(ARENA_IO_ALIGN - 1);
+
+    if (arena->flags & _ARENA_FLAGS_SLOW)
+    {
+        ptr = _arena_alloc_slow(arena, size, ARENA_IO_ALIGN);
+        if (ptr && padded)
+            *padded = size;
+        return ptr;
+    }
+
+    ARENA_LOCK();
+
+    current_addr = (unsigned long)(arena->data + arena->pos);
+    new_pos = arena->pos + (ARENA_IO_ALIGN - (current_addr % ARENA_IO_ALIGN)) % ARENA_IO_ALIGN;
+
+    if (new_pos > arena->capacity || size > arena->capacity - new_pos)
+    {
+        _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+        ARENA_UNLOCK();
+        ptr = _arena_overflow(arena, size, ARENA_IO_ALIGN, NULL);
+        if (ptr && padded)
+            *padded = size;
+        return ptr;
+    }
+
+    ptr = arena->data + new_pos;
+    arena->pos = new_pos + size;
+
+    ARENA_UNLOCK();
+
+    if (padded)
+        *padded = size;
+    return ptr;
+}
+
+/* ============================================================================
+ * arena_reserve - returns the free tail (at least min bytes, *avail set to
+ * its length) without allocating it; arena_commit() keeps what was used.
+ * A tail shorter than min goes to the overflow handler like an allocation.
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(reserve)(arena_t *arena, unsigned long min, unsigned long *avail)
+{
+    unsigned long tail;
+    void *ptr;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    if (arena->flags & (_ARENA_FLAG_SHARED | _ARENA_FLAG_READONLY))
+    {
+        _ARENA_FAIL(arena, ARENA_E_UNSUPPORTED);
+        return NULL;
+    }
+
+    ARENA_LOCK();
+
+    if ((arena->flags & _ARENA_FLAG_CHILD) && !_arena_child_live(arena))
+    {
+        _ARENA_FAIL(arena, ARENA_E_PARENT_RESET);
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    tail = arena->capacity - arena->pos;
+    if (tail < min)
+    {
+        _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+        ARENA_UNLOCK();
+        return _arena_overflow(arena, min, 1, avail);
+    }
+
+    ptr = arena->data + arena->pos;
+    arena->reserved = (unsigned char *)ptr;
+    arena->reserved_len = tail;
+
+    ARENA_UNLOCK();
+
+    if (avail)
+        *avail = tail;
+    return ptr;
+}
+
+/* ============================================================================
+ * arena_commit - allocates the first used bytes of the open reservation
+ * used may be 0 to drop it. Returns 0 on success, -1 if there is no
+ * reservation, it was cancelled, or used exceeds it.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(commit)(arena_t *arena, unsigned long used)
+{
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    ARENA_LOCK();
+
+    if (!arena->reserved || arena->reserved != arena->data + arena->pos)
+    {
+        arena->reserved = NULL;
+        _ARENA_FAIL(arena, ARENA_E_STATE);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    if (used > arena->reserved_len)
+    {
+        _ARENA_FAIL(arena, ARENA_E_STATE);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    arena->pos += used;
+    arena->reserved = NULL;
+    if (used)
+        _ARENA_TRACE(arena, ARENA_TRACE_ALLOC, used, 0);
+
+    ARENA_UNLOCK();
+    return 0;
+}
+
+/* ============================================================================
+ * arena_set_overflow - installs fn(arena, size, alignment, ctx) to run when
+ * an allocation does not fit; NULL restores plain failure
+ * ============================================================================
+ */
+void _ARENA_PREFIX(set_overflow)(arena_t *arena, arena_overflow_fn fn, void *ctx)
+{
+    if (!arena)
+        return;
+
+    ARENA_LOCK();
+    arena->on_overflow = fn;
+    arena->overflow_ctx = ctx;
+    ARENA_UNLOCK();
+}
+
+/* ============================================================================
+ * arena_overflow_abort - overflow handler that stops the process
+ * ============================================================================
+ */
+int _ARENA_PREFIX(overflow_abort)(arena_t *arena, unsigned long size, unsigned long alignment, void *ctx)
+{
+    (void)arena;
+    (void)alignment;
+    (void)ctx;
+#ifdef ARENA_STDIO
+    fprintf(stderr, "arena overflow: %lu bytes requested\n", size);
+#else
+    (void)size;
+#endif
+    ARENA_ABORT();
+    return 0;
+}
+
+#ifndef ARENA_NOALLOC
+/* ============================================================================
+ * arena_overflow_grow - overflow handler that chains a new heap block
+ * The block holds at least the request and is no smaller than the current
+ * one. If ctx is not NULL it points to an unsigned long limit on the total
+ * capacity of all blocks. Returns 0 for real-time and non-heap arenas.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(overflow_grow)(arena_t *arena, unsigned long size, unsigned long alignment, void *ctx)
+{
+    struct _arena_block *block, *current, *b;
+    unsigned long need, capacity, total;
+
+    if (!(arena->flags & _ARENA_FLAG_HEAP) || (arena->flags & _ARENA_FLAG_REALTIME))
+        return 0;
+
+    if (size > ~0UL - alignment)
+        return 0;
+    need = size + alignment - 1; /* Worst case padding in a 16-aligned block */
+
+    ARENA_LOCK();
+
+    capacity = arena->capacity > need ? arena->capacity : need;
+    if (ctx)
+    {
+        total = arena->capacity;
+        for (b = arena->blocks; b; b = b->prev)
+            total += b->capacity;
+        if (total > *(const unsigned long *)ctx || capacity > *(const unsigned long *)ctx - total)
+        {
+            _ARENA_FAIL(arena, ARENA_E_OVERFLOW);
+            ARENA_UNLOCK();
+            return 0;
+        }
+    }
+
+    block = _arena_block_new(capacity);
+    if (!block)
+    {
+        _ARENA_FAIL(arena, ARENA_E_NOMEM);
+        ARENA_UNLOCK();
+        return 0;
+    }
+
+    current = _ARENA_BLOCK(arena->data);
+    current->pos = arena->pos;
+    current->prev = arena->blocks;
+    arena->blocks = current;
+
+    arena->data = _ARENA_BLOCK_DATA(block);
+    arena->capacity = capacity;
+    arena->pos = 0;
+    arena->peak = 0;
+    arena->reserved = NULL;
+
+    ARENA_UNLOCK();
+    return 1;
+}
+
+/* ============================================================================
+ * arena_set_large_threshold - allocations of more than bytes get their own
+ * block, freed on reset/rewind/destroy; 0 turns the bypass off (default).
+ * Only arenas from arena_init support it. Returns 0 on success, else -1.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(set_large_threshold)(arena_t *arena, unsigned long bytes)
+{
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (!(arena->flags & _ARENA_FLAG_HEAP))
+    {
+        _ARENA_FAIL(arena, ARENA_E_UNSUPPORTED);
+        return -1;
+    }
+
+    ARENA_LOCK();
+    arena->large_threshold = bytes ? bytes : ~0UL;
+    ARENA_UNLOCK();
+    return 0;
+}
+
+#ifdef ARENA_BLOCK_CACHE
+/* ============================================================================
+ * arena_cache_trim - frees every block and arena struct held by the cache
+ * ============================================================================
+ */
+void _ARENA_PREFIX(cache_trim)(void)
+{
+    void *ptr;
+    int size_class;
+
+    for (size_class = 0; size_class < ARENA_BLOCK_CACHE_CLASSES; size_class++)
+        while ((ptr = _arena_cache_get(_arena_cache_blocks[size_class],
+                                       _ARENA_BLOCK_HEADER + (1UL << (ARENA_BLOCK_CACHE_MIN_SHIFT + size_class)))))
+            ARENA_FREE(ptr);
+
+    while ((ptr = _arena_cache_get(_arena_cache_arenas, sizeof(arena_t))))
+        ARENA_FREE(ptr);
+}
+#endif
+#endif
+
+#if !defined(__GNUC__) && !defined(__clang__)
+static void *_arena_memcpy(void *dst, const void *src, unsigned long n)
+{
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+
+    while (n--)
+        *d++ = *s++;
+    return dst;
+}
+#endif
+
+/* ============================================================================
+ * arena_memdup - copies len bytes of src into the arena
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(memdup)(arena_t *arena, const void *src, unsigned long len)
+{
+    void *dst;
+
+    if (len > INT_MAX)
+    {
+        if (arena)
+            _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    dst = _ARENA_PREFIX(alloc)(arena, (int)len);
+    if (dst)
+        ARENA_MEMCPY(dst, src, len);
+    return dst;
+}
+
+/* ============================================================================
+ * arena_strdup - copies str, terminator included, into the arena
+ * ============================================================================
+ */
+char *arena_strdup(arena_t *arena, const char *str)
+{
+    unsigned long len = 0;
+
+    while (str[len])
+        len++;
+    return (char *)_ARENA_PREFIX(memdup)(arena, str, len + 1);
+}
+
+#ifdef ARENA_STDIO
+/* ============================================================================
+ * arena_vsprintf - formats into the arena and keeps exactly the bytes used
+ * The first vsnprintf writes straight into the free tail; only if the
+ * result does not fit is it formatted again into a fresh allocation.
+ * ============================================================================
+ */
+char *arena_vsprintf(arena_t *arena, const char *fmt, va_list ap)
+{
+    va_list again;
+    char *str;
+    int len;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    _ARENA_VA_COPY(again, ap);
+
+    if (!(arena->flags & _ARENA_FLAGS_SLOW))
+    {
+        ARENA_LOCK();
+
+        str = (char *)arena->data + arena->pos;
+        len = vsnprintf(str, arena->capacity - arena->pos, fmt, ap);
+        if (len >= 0 && (unsigned long)len < arena->capacity - arena->pos)
+        {
+            arena->pos += (unsigned long)len + 1;
+            _ARENA_TRACE(arena, ARENA_TRACE_ALLOC, (unsigned long)len + 1, 0);
+            ARENA_UNLOCK();
+            va_end(again);
+            return str;
+        }
+
+        ARENA_UNLOCK();
+    }
+    else
+        len = vsnprintf(NULL, 0, fmt, ap);
+
+    if (len < 0 || len == INT_MAX)
+    {
+        _ARENA_FAIL(arena, ARENA_E_ARGUMENT);
+        va_end(again);
+        return NULL;
+    }
+
+    str = (char *)_ARENA_PREFIX(alloc)(arena, len + 1);
+    if (str)
+        vsnprintf(str, (unsigned long)len + 1, fmt, again);
+    va_end(again);
+    return str;
+}
+
+/* ============================================================================
+ * arena_sprintf - arena_vsprintf() with variadic arguments
+ * ============================================================================
+ */
+char *arena_sprintf(arena_t *arena, const char *fmt, ...)
+{
+    va_list ap;
+    char *str;
+
+    va_start(ap, fmt);
+    str = arena_vsprintf(arena, fmt, ap);
+    va_end(ap);
+    return str;
+}
+#endif
+
+/* ============================================================================
+ * arena_seg_init - sets up an empty segmented array of elem_size-byte
+ * elements (padded to alignment) whose first segment holds first elements,
+ * rounded up to a power of two (0: 16). Allocates nothing yet.
+ * Returns 0 on success, else -1.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(seg_init)(arena_seg_t *seg, arena_t *arena, unsigned long elem_size,
+                            unsigned long alignment, unsigned long first)
+{
+    int k;
+
+    if (!seg || !arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > INT_MAX)
+    {
+        _ARENA_FAIL(arena, ARENA_E_ALIGN);
+        return -1;
+    }
+
+    elem_size = (elem_size + alignment - 1) & ~(alignment - 1);
+    if (!first)
+        first = 16;
+    if (elem_size == 0 || first > INT_MAX || elem_size > INT_MAX / first)
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return -1;
+    }
+
+    seg->arena = arena;
+    seg->elem_size = elem_size;
+    seg->alignment = alignment;
+    seg->count = 0;
+    seg->gen = arena->generation;
+    seg->shift = _arena_log2(first);
+    if (first & (first - 1))
+        seg->shift++;
+    seg->segments = 0;
+    for (k = 0; k < ARENA_SEG_DIR; k++)
+        seg->dir[k] = NULL;
+    return 0;
+}
+
+/* ============================================================================
+ * arena_seg_push - appends an uninitialized element and returns it
+ * Allocates the next segment, twice the size of the last, when the last
+ * is full; elements already pushed never move. Returns NULL on failure.
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(seg_push)(arena_seg_t *seg)
+{
+    int k;
+
+    if (!seg || !seg->arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    if (seg->gen != seg->arena->generation)
+    {
+        _ARENA_FAIL(seg->arena, ARENA_E_STATE);
+        return NULL;
+    }
+
+    k = seg->segments;
+    if (seg->count == ((1UL << k) - 1) << seg->shift)
+    {
+        void *p;
+
+        if (k == ARENA_SEG_DIR || seg->shift + k >= (int)(sizeof(unsigned long) * 8) ||
+            seg->elem_size > (unsigned long)INT_MAX >> (seg->shift + k))
+        {
+            _ARENA_FAIL(seg->arena, ARENA_E_SIZE);
+            return NULL;
+        }
+
+        p = _ARENA_PREFIX(alloc_aligned)(seg->arena, (int)(seg->elem_size << (seg->shift + k)),
+                                         (int)seg->alignment);
+        if (!p)
+            return NULL;
+        seg->dir[k] = (unsigned char *)p;
+        seg->segments++;
+    }
+
+    seg->count++;
+    return _ARENA_PREFIX(seg_at)(seg, seg->count - 1);
+}
+
+#ifdef ARENA_POSIX
+#ifdef IOV_MAX
+#define _ARENA_IOV_MAX IOV_MAX
+#else
+#define _ARENA_IOV_MAX 1024
+#endif
+
+/* ============================================================================
+ * arena_readv - allocates one I/O buffer per lens[i] back to back, fills
+ * iov[0..count) with them (padded lengths) and issues a single readv().
+ * Returns the bytes read, or -1 with the arena rewound on failure.
+ * ============================================================================
+ */
+long arena_readv(arena_t *arena, int fd, const unsigned long *lens, int count, struct iovec *iov)
+{
+    arena_mark_t start;
+    ssize_t n;
+    int i;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (count <= 0 || count > _ARENA_IOV_MAX)
+    {
+        _ARENA_FAIL(arena, ARENA_E_ARGUMENT);
+        return -1;
+    }
+
+    start = _ARENA_PREFIX(mark)(arena);
+    for (i = 0; i < count; i++)
+    {
+        unsigned long padded;
+        iov[i].iov_base = _ARENA_PREFIX(alloc_io)(arena, lens[i], &padded);
+        if (!iov[i].iov_base)
+        {
+            arena_rewind(arena, start);
+            return -1;
+        }
+        iov[i].iov_len = padded;
+    }
+
+    n = readv(fd, iov, count);
+    if (n < 0)
+    {
+        arena_rewind(arena, start);
+        _ARENA_FAIL(arena, ARENA_E_IO);
+        return -1;
+    }
+    return (long)n;
+}
+
+/* ============================================================================
+ * arena_read_file - reads a whole file into the arena with one read()
+ * (more only if the kernel returns short). The data is NUL-terminated;
+ * its length, without the terminator, is stored in *len.
+ * ============================================================================
+ */
+void *_ARENA_PREFIX(read_file)(arena_t *arena, const char *path, unsigned long *len)
+{
+    struct stat st;
+    unsigned long size, got = 0;
+    unsigned char *buf;
+    int fd;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        _ARENA_FAIL(arena, ARENA_E_IO);
+        return NULL;
+    }
+
+    size = (unsigned long)st.st_size;
+    if (size >= (unsigned long)INT_MAX)
+    {
+        close(fd);
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    buf = (unsigned char *)_ARENA_PREFIX(alloc_aligned)(arena, (int)size + 1, 64);
+    if (!buf)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    while (got < size)
+    {
+        ssize_t n = read(fd, buf + got, size - got);
+        if (n < 0)
+        {
+            close(fd);
+            _ARENA_FAIL(arena, ARENA_E_IO);
+            return NULL;
+        }
+        if (n == 0)
+            break; /* File shrank */
+        got += (unsigned long)n;
+    }
+    close(fd);
+
+    buf[got] = '\0';
+    if (len)
+        *len = got;
+    return buf;
+}
+
+/* ============================================================================
+ * arena_iovec - describes the bytes allocated since from as iovecs, ready
+ * for writev()/sendmsg(). Returns the number of entries used (0 if nothing
+ * was allocated), or -1 if the mark is invalid, max is too small or a
+ * large object was allocated since the mark.
+ * ============================================================================
+ */
+int arena_iovec(arena_t *arena, arena_mark_t from, struct iovec *iov, int max)
+{
+    struct _arena_block *block = NULL;
+    unsigned long pos;
+    int count = 0, where, i;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    ARENA_LOCK();
+
+    where = _arena_find_mark(arena, from, &block);
+    if (!where)
+    {
+        _ARENA_FAIL(arena, ARENA_E_MARK);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    /* Large objects live outside the blocks, so they could not be listed */
+    if (arena->large != from.large)
+    {
+        _ARENA_FAIL(arena, ARENA_E_UNSUPPORTED);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    /* Older blocks from the mark's onwards, oldest first; then the current */
+    if (where == 2)
+    {
+        struct _arena_block *b;
+        int n = 1;
+
+        for (b = arena->blocks; b != block; b = b->prev)
+            n++;
+        if (n + 1 > max)
+        {
+            _ARENA_FAIL(arena, ARENA_E_ARGUMENT);
+            ARENA_UNLOCK();
+            return -1;
+        }
+
+        for (b = arena->blocks; b != block; b = b->prev)
+        {
+            iov[--n].iov_base = _ARENA_BLOCK_DATA(b);
+            iov[n].iov_len = b->pos;
+        }
+        iov[0].iov_base = _ARENA_BLOCK_DATA(block) + from.pos;
+        iov[0].iov_len = block->pos - from.pos;
+
+        /* Drop empty entries */
+        for (b = arena->blocks, n = 0; b != block; b = b->prev)
+            n++;
+        for (i = 0; i <= n; i++)
+            if (iov[i].iov_len > 0)
+                iov[count++] = iov[i];
+        from.pos = 0;
+    }
+
+    pos = _arena_pos(arena);
+    if (from.pos < pos)
+    {
+        if (count >= max)
+        {
+            _ARENA_FAIL(arena, ARENA_E_ARGUMENT);
+            ARENA_UNLOCK();
+            return -1;
+        }
+        iov[count].iov_base = arena->data + from.pos;
+        iov[count].iov_len = pos - from.pos;
+        count++;
+    }
+
+    ARENA_UNLOCK();
+    return count;
+}
+
+/* ============================================================================
+ * arena_realtime - makes every page of the arena resident and locked
+ * The pages are populated without writing to them (MADV_POPULATE_WRITE
+ * where available, then one read per page), so the contents of shared and
+ * file-backed arenas are never touched, and the range is mlock()ed, which
+ * faults in whatever is left. From then on the arena never trims, so
+ * allocating from it needs no syscall (beyond whatever ARENA_LOCK() does).
+ * The warmup time is stored in *warmup_ns when it is not NULL. Returns 0,
+ * or -1 if mlock() failed (the pages are still faulted in) or the arena is
+ * read-only or already real-time.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(realtime)(arena_t *arena, unsigned long *warmup_ns)
+{
+    struct timespec t0, t1;
+    const volatile unsigned char *p;
+    unsigned long off;
+    int rc;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (arena->flags & _ARENA_FLAG_READONLY)
+    {
+        _ARENA_FAIL(arena, ARENA_E_READONLY);
+        return -1;
+    }
+
+    if (arena->flags & _ARENA_FLAG_REALTIME)
+    {
+        _ARENA_FAIL(arena, ARENA_E_STATE);
+        return -1;
+    }
+
+    ARENA_LOCK();
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* Never write: another process may be using a shared arena's bytes */
+#ifdef MADV_POPULATE_WRITE
+    off = (unsigned long)arena->data & (ARENA_PAGE_SIZE - 1);
+    madvise(arena->data - off, arena->capacity + off, MADV_POPULATE_WRITE);
+#endif
+    p = arena->data;
+    for (off = 0; off < arena->capacity; off += ARENA_PAGE_SIZE)
+        (void)p[off];
+    if (arena->capacity > 0)
+        (void)p[arena->capacity - 1];
+
+    rc = mlock(arena->data, arena->capacity);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (rc == 0)
+        arena->flags |= _ARENA_FLAG_REALTIME;
+    else
+        _ARENA_FAIL(arena, ARENA_E_IO);
+
+    ARENA_UNLOCK();
+
+    if (warmup_ns)
+        *warmup_ns = (unsigned long)(t1.tv_sec - t0.tv_sec) * 1000000000UL +
+                     (unsigned long)t1.tv_nsec - (unsigned long)t0.tv_nsec;
+    return rc == 0 ? 0 : -1;
+}
+
+#ifndef ARENA_NOALLOC
+/* ============================================================================
+ * arena_init_realtime - arena_init() followed by arena_realtime()
+ * Returns NULL (and frees the arena) if the pages cannot be locked.
+ * ============================================================================
+ */
+arena_t *_ARENA_PREFIX(init_realtime)(int size, unsigned long *warmup_ns)
+{
+    arena_t *arena = _ARENA_PREFIX(init)(size);
+    if (!arena)
+        return NULL;
+
+    if (_ARENA_PREFIX(realtime)(arena, warmup_ns) != 0)
+    {
+        _ARENA_PREFIX(destroy)(arena);
+        _arena_last_error = ARENA_E_IO;
+        return NULL;
+    }
+    return arena;
+}
+#endif
+#endif
+
+/* ============================================================================
+ * _arena_scan - finds every delim byte in p[0..len). With out == NULL the
+ * matches are only counted; otherwise the offset just past each match is
+ * stored in out. Uses AVX2 or SSE2 when the compiler targets them.
+ * ============================================================================
+ */
+static unsigned long _arena_scan(const unsigned char *p, unsigned long len, unsigned char delim,
+                                 unsigned long *out)
+{
+    unsigned long i = 0, n = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+    const unsigned long width = 32;
+    const __m256i needle = _mm256_set1_epi8((char)delim);
+#else
+    const unsigned long width = 16;
+    const __m128i needle = _mm_set1_epi8((char)delim);
+#endif
+
+    for (; i + width <= len; i += width)
+    {
+#if defined(__AVX2__)
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), needle));
+#else
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), needle));
+#endif
+        if (!out)
+        {
+            n += (unsigned long)__builtin_popcount(mask);
+            continue;
+        }
+        while (mask)
+        {
+            out[n++] = i + (unsigned long)__builtin_ctz(mask) + 1;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < len; i++)
+    {
+        if (p[i] != delim)
+            continue;
+        if (out)
+            out[n] = i + 1;
+        n++;
+    }
+    return n;
+}
+
+/* ============================================================================
+ * arena_split - indexes the records of buf separated by delim
+ * Returns an arena-allocated array of *count + 1 offsets: record i is
+ * buf[offs[i] .. offs[i + 1] - 1), i.e. without its delimiter. A last
+ * record with no trailing delimiter is counted as if it had one.
+ * ============================================================================
+ */
+unsigned long *_ARENA_PREFIX(split)(arena_t *arena, const void *buf, unsigned long len, int delim,
+                                    unsigned long *count)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned long n, *offs;
+    int unterminated = len > 0 && p[len - 1] != (unsigned char)delim;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return NULL;
+    }
+
+    n = _arena_scan(p, len, (unsigned char)delim, NULL) + unterminated;
+
+    if (n + 1 > (unsigned long)INT_MAX / sizeof(unsigned long))
+    {
+        _ARENA_FAIL(arena, ARENA_E_SIZE);
+        return NULL;
+    }
+
+    offs = ARENA_NEW(arena, unsigned long, n + 1);
+    if (!offs)
+        return NULL;
+
+    offs[0] = 0;
+    _arena_scan(p, len, (unsigned char)delim, offs + 1);
+    if (unterminated)
+        offs[n] = len + 1;
+
+    if (count)
+        *count = n;
+    return offs;
+}
+
+/* ============================================================================
+ * arena_index_lines - arena_split() on '\n'
+ * ============================================================================
+ */
+unsigned long *_ARENA_PREFIX(index_lines)(arena_t *arena, const void *buf, unsigned long len,
+                                          unsigned long *count)
+{
+    return _ARENA_PREFIX(split)(arena, buf, len, '\n', count);
+}
+
+/* ============================================================================
+ * Cleanup list - nodes are carved from the arena itself
+ * ============================================================================
+ */
+struct _arena_cleanup
+{
+    arena_cleanup_fn fn;
+    void *ctx;
+    struct _arena_cleanup *next;
+};
+
+/* ============================================================================
+ * arena_add_cleanup - registers fn(ctx) to run on the next reset/destroy
+ * Returns 0 on success, -1 if the arena has no room for the node.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(add_cleanup)(arena_t *arena, arena_cleanup_fn fn, void *ctx)
+{
+    struct _arena_cleanup *node;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (!fn)
+    {
+        _ARENA_FAIL(arena, ARENA_E_NULL);
+        return -1;
+    }
+
+    node = (struct _arena_cleanup *)_ARENA_PREFIX(alloc_aligned)(
+        arena, (int)sizeof(struct _arena_cleanup), (int)ARENA_ALIGNOF(struct _arena_cleanup));
+    if (!node)
+        return -1;
+
+    node->fn = fn;
+    node->ctx = ctx;
+
+    ARENA_LOCK();
+    node->next = arena->cleanups;
+    arena->cleanups = node;
+    ARENA_UNLOCK();
+
+    return 0;
+}
+
+/* ============================================================================
+ * _arena_run_cleanups - runs registered cleanups newest first, stopping at
+ * node stop (all of them if stop is NULL). The lock is not held while they
+ * run, so cleanups may use the arena themselves.
+ * ============================================================================
+ */
+static void _arena_run_cleanups(arena_t *arena, const struct _arena_cleanup *stop)
+{
+    struct _arena_cleanup *node;
+
+    for (;;)
+    {
+        ARENA_LOCK();
+        node = arena->cleanups;
+        if (node == stop)
+            node = NULL;
+        if (node)
+            arena->cleanups = node->next;
+        ARENA_UNLOCK();
+
+        if (!node)
+            break;
+        node->fn(node->ctx);
+    }
+}
+
+/* ============================================================================
+ * _arena_trim_locked - releases whole pages between max(pos, keep) and the
+ * high-water mark. Caller must hold ARENA_LOCK().
+ * ============================================================================
+ */
+static unsigned long _arena_trim_locked(arena_t *arena, unsigned long keep)
+{
+    unsigned long start, end, limit, pos = _arena_pos(arena);
+
+    if (pos > arena->peak)
+        arena->peak = pos;
+    if (arena->flags & _ARENA_FLAG_REALTIME)
+        return 0; /* Pages stay resident and locked */
+    if (keep < pos)
+        keep = pos;
+    if (keep >= arena->peak)
+        return 0;
+
+    /* Only whole pages that lie inside the arena may be released */
+    start = (unsigned long)(arena->data + keep);
+    start = (start + ARENA_PAGE_SIZE - 1) & ~(ARENA_PAGE_SIZE - 1);
+    end = (unsigned long)(arena->data + arena->peak);
+    end = (end + ARENA_PAGE_SIZE - 1) & ~(ARENA_PAGE_SIZE - 1);
+    limit = (unsigned long)(arena->data + arena->capacity) & ~(ARENA_PAGE_SIZE - 1);
+    if (end > limit)
+        end = limit;
+
+    arena->peak = keep;
+    if (end <= start)
+        return 0;
+
+    ARENA_DECOMMIT((void *)start, end - start);
+    return end - start;
+}
+
+/* ============================================================================
+ * arena_reset - resets arena to reuse memory (pos = 0)
+ * Pages above the retained size (see arena_set_retain) are released.
+ * ============================================================================
+ */
+void _ARENA_PREFIX(reset)(arena_t *arena)
+{
+    if (!arena)
+        return;
+
+    _ARENA_TRACE(arena, ARENA_TRACE_RESET, 0, 0);
+
+    if (arena->flags & _ARENA_FLAG_READONLY)
+    {
+        _ARENA_FAIL(arena, ARENA_E_READONLY);
+        return;
+    }
+
+    _arena_run_cleanups(arena, NULL);
+
+    ARENA_LOCK();
+
+    _arena_note_usage(arena);
+    if (_arena_pos(arena) > arena->peak)
+        arena->peak = _arena_pos(arena);
+    arena->pos = 0;
+    arena->reserved = NULL;
+    if (++arena->generation == ARENA_GEN_NULL)
+        arena->generation = 0;
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+    if (arena->flags & _ARENA_FLAG_SHARED)
+        _ARENA_ATOMIC_STORE(&((_arena_file_header *)(arena->data - ARENA_FILE_HEADER_SIZE))->pos, 0UL);
+#endif
+#ifndef ARENA_NOALLOC
+    _arena_free_blocks(arena, NULL); /* Keep only the current block */
+    _arena_free_large(arena, NULL);
+#endif
+    if (arena->peak > arena->retain)
+        _arena_trim_locked(arena, arena->retain);
+
+    ARENA_UNLOCK();
+}
+
+/* ============================================================================
+ * arena_mark - returns the current position for a later arena_rewind
+ * ============================================================================
+ */
+arena_mark_t _ARENA_PREFIX(mark)(arena_t *arena)
+{
+    arena_mark_t mark;
+
+    mark.data = NULL;
+    mark.pos = 0;
+    mark.cleanups = NULL;
+    mark.large = NULL;
+    if (!arena)
+        return mark;
+
+    ARENA_LOCK();
+    mark.data = arena->data;
+    mark.pos = _arena_pos(arena);
+    mark.cleanups = arena->cleanups;
+    mark.large = arena->large;
+    ARENA_UNLOCK();
+
+    return mark;
+}
+
+/* ============================================================================
+ * arena_rewind - frees everything allocated since mark
+ * Cleanups registered since the mark run first, newest first.
+ * ============================================================================
+ */
+void arena_rewind(arena_t *arena, arena_mark_t mark)
+{
+    struct _arena_block *block = NULL;
+    int where;
+
+    if (!arena)
+        return;
+
+    if (arena->flags & _ARENA_FLAG_READONLY)
+    {
+        _ARENA_FAIL(arena, ARENA_E_READONLY);
+        return;
+    }
+
+    ARENA_LOCK();
+    where = _arena_find_mark(arena, mark, &block);
+    ARENA_UNLOCK();
+
+    if (!where)
+    {
+        _ARENA_FAIL(arena, ARENA_E_MARK);
+        return;
+    }
+
+    _arena_run_cleanups(arena, mark.cleanups);
+
+    ARENA_LOCK();
+
+    _arena_note_usage(arena);
+    if (_arena_pos(arena) > arena->peak)
+        arena->peak = _arena_pos(arena);
+#ifndef ARENA_NOALLOC
+    _arena_free_large(arena, mark.large);
+    if (where == 2)
+    {
+        /* Drop every block newer than the mark's and continue in it */
+        _arena_free_blocks(arena, block);
+        _arena_block_free(_ARENA_BLOCK(arena->data));
+        arena->blocks = block->prev;
+        arena->data = _ARENA_BLOCK_DATA(block);
+        arena->capacity = block->capacity;
+        arena->peak = block->pos;
+    }
+#endif
+    arena->pos = mark.pos;
+    arena->reserved = NULL;
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+    if (arena->flags & _ARENA_FLAG_SHARED)
+        _ARENA_ATOMIC_STORE(&((_arena_file_header *)(arena->data - ARENA_FILE_HEADER_SIZE))->pos, mark.pos);
+#endif
+
+    ARENA_UNLOCK();
+}
+
+/* ============================================================================
+ * arena_set_retain - sets how many bytes arena_reset keeps committed
+ * Defaults to ~0UL, i.e. arena_reset never trims, however far the arena
+ * has grown since it was created.
+ * ============================================================================
+ */
+void _ARENA_PREFIX(set_retain)(arena_t *arena, unsigned long bytes)
+{
+    if (!arena)
+        return;
+
+    ARENA_LOCK();
+    arena->retain = bytes;
+    ARENA_UNLOCK();
+}
+
+/* ============================================================================
+ * arena_trim - releases pages above max(pos, keep) back to the OS
+ * Returns the number of bytes handed back (0 if nothing could be released).
+ * ============================================================================
+ */
+unsigned long _ARENA_PREFIX(trim)(arena_t *arena, unsigned long keep)
+{
+    unsigned long released;
+
+    if (!arena)
+        return 0;
+
+    ARENA_LOCK();
+    released = _arena_trim_locked(arena, keep);
+    ARENA_UNLOCK();
+
+    return released;
+}
+
+/* ============================================================================
+ * arena_destroy - frees arena memory (only for dynamic arena)
+ * ============================================================================
+ */
+#ifndef ARENA_NOALLOC
+void _ARENA_PREFIX(destroy)(arena_t *arena)
+{
+    if (!arena)
+        return;
+
+    _ARENA_TRACE(arena, ARENA_TRACE_DESTROY, 0, 0);
+
+    _arena_run_cleanups(arena, NULL);
+    if (arena->flags & _ARENA_FLAG_BORROWED)
+        return;
+
+    _arena_unregister(arena);
+    ARENA_LOCK();
+
+#ifdef ARENA_POSIX
+    if (arena->flags & _ARENA_FLAG_REALTIME)
+        munlock(arena->data, arena->capacity);
+    if (arena->flags & _ARENA_FLAG_FILE)
+        ((_arena_file_header *)(arena->data - ARENA_FILE_HEADER_SIZE))->pos = arena->pos;
+    if (arena->flags & _ARENA_FLAG_MAPPED)
+        munmap(arena->data - ARENA_FILE_HEADER_SIZE, ARENA_FILE_HEADER_SIZE + arena->capacity);
+#endif
+    if (arena->flags & _ARENA_FLAG_HEAP)
+    {
+        _arena_free_blocks(arena, NULL);
+        _arena_free_large(arena, NULL);
+        _arena_block_free(_ARENA_BLOCK(arena->data));
+    }
+    _arena_struct_free(arena);
+
+    ARENA_UNLOCK();
+}
+
+/* ============================================================================
+ * arena_transfer - moves the blocks allocated in src since mark to dst,
+ * without copying. Blocks are the unit: the block the mark lies in moves
+ * whole, so anything src allocated before the mark in that same block now
+ * lives (and dies) with dst too. src continues in a fresh block of its
+ * current size and its generation is bumped; cleanups registered since the
+ * mark move with the data. Both arenas must come from arena_init.
+ * Fails with ARENA_E_MARK if a cleanup registered before the mark lies in
+ * the moved block, since src still runs it; children carved from that
+ * block stop allocating (ARENA_E_PARENT_RESET).
+ * Returns 0 on success, -1 on failure (nothing is moved).
+ * ============================================================================
+ */
+int _ARENA_PREFIX(transfer)(arena_t *dst, arena_t *src, arena_mark_t mark)
+{
+    struct _arena_block *mark_block = NULL, *fresh, *dst_current;
+    struct _arena_cleanup *last, *node;
+
+    if (!dst || !src)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (dst == src || !(dst->flags & src->flags & _ARENA_FLAG_HEAP) ||
+        ((dst->flags | src->flags) & _ARENA_FLAG_REALTIME))
+    {
+        _ARENA_FAIL(src, ARENA_E_UNSUPPORTED);
+        return -1;
+    }
+
+    ARENA_LOCK();
+
+    if (!_arena_find_mark(src, mark, &mark_block))
+    {
+        _ARENA_FAIL(src, ARENA_E_MARK);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    /* Cleanups src keeps must not lie in the part of the block that moves */
+    for (node = mark.cleanups; node; node = node->next)
+    {
+        if ((unsigned char *)node >= mark.data && (unsigned char *)node < mark.data + mark.pos)
+        {
+            _ARENA_FAIL(src, ARENA_E_MARK);
+            ARENA_UNLOCK();
+            return -1;
+        }
+    }
+
+    fresh = _arena_block_new(src->capacity);
+    if (!fresh)
+    {
+        _ARENA_FAIL(src, ARENA_E_NOMEM);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    _arena_note_usage(src);
+
+    /* Cleanups registered since the mark follow their data */
+    if (src->cleanups != mark.cleanups)
+    {
+        for (last = src->cleanups; last->next != mark.cleanups; last = last->next)
+            ;
+        last->next = dst->cleanups;
+        dst->cleanups = src->cleanups;
+        src->cleanups = mark.cleanups;
+    }
+
+    /* So do large objects */
+    if (src->large != mark.large)
+    {
+        struct _arena_large *tail;
+        for (tail = src->large; tail->next != mark.large; tail = tail->next)
+            ;
+        tail->next = dst->large;
+        dst->large = src->large;
+        src->large = mark.large;
+    }
+
+    /* Retire dst's current block */
+    dst_current = _ARENA_BLOCK(dst->data);
+    dst_current->pos = dst->pos;
+    dst_current->prev = dst->blocks;
+    dst->blocks = dst_current;
+
+    /* Older src blocks from the mark's onwards go behind it */
+    if (mark_block)
+    {
+        struct _arena_block *keep = mark_block->prev;
+        mark_block->prev = dst->blocks;
+        dst->blocks = src->blocks;
+        src->blocks = keep;
+    }
+
+    /* src's current block becomes dst's current block */
+    dst->data = src->data;
+    dst->capacity = src->capacity;
+    dst->pos = src->pos;
+    dst->peak = src->pos;
+
+    src->data = _ARENA_BLOCK_DATA(fresh);
+    src->capacity = fresh->capacity;
+    src->pos = 0;
+    src->reserved = NULL;
+    src->peak = 0;
+    if (++src->generation == ARENA_GEN_NULL)
+        src->generation = 0;
+
+    ARENA_UNLOCK();
+    return 0;
+}
+#endif
+
+#ifndef ARENA_NOALLOC
+/* ============================================================================
+ * Scratch pool - ARENA_SCRATCH_COUNT arenas per thread, created on first use
+ * With ARENA_POSIX they are destroyed at thread exit through a pthread key;
+ * otherwise they live until the process exits.
+ * ============================================================================
+ */
+static ARENA_TLS arena_t *_arena_scratch[ARENA_SCRATCH_COUNT];
+
+#ifdef ARENA_POSIX
+static pthread_key_t _arena_scratch_key;
+static pthread_once_t _arena_scratch_once = PTHREAD_ONCE_INIT;
+
+static void _arena_scratch_teardown(void *pool)
+{
+    arena_t **arenas = (arena_t **)pool;
+    int i;
+
+    for (i = 0; i < ARENA_SCRATCH_COUNT; i++)
+    {
+        _ARENA_PREFIX(destroy)(arenas[i]);
+        arenas[i] = NULL;
+    }
+}
+
+static void _arena_scratch_make_key(void)
+{
+    pthread_key_create(&_arena_scratch_key, _arena_scratch_teardown);
+}
+#endif
+
+/* ============================================================================
+ * arena_scratch_begin - returns a thread-local scratch arena that is not
+ * one of conflicts[0..count), marked at its current position.
+ * temp.arena is NULL if every scratch arena conflicts or creation failed.
+ * ============================================================================
+ */
+arena_temp_t _ARENA_PREFIX(scratch_begin)(arena_t *const *conflicts, int count)
+{
+    arena_temp_t temp;
+    int i, j;
+
+    temp.arena = NULL;
+    temp.mark = _ARENA_PREFIX(mark)(NULL);
+
+    for (i = 0; i < ARENA_SCRATCH_COUNT; i++)
+    {
+        arena_t *candidate = _arena_scratch[i];
+
+        for (j = 0; j < count; j++)
+            if (candidate && conflicts[j] == candidate)
+                break;
+        if (j < count)
+            continue;
+
+        if (!candidate)
+        {
+            candidate = _ARENA_PREFIX(init)(ARENA_SCRATCH_SIZE);
+            if (!candidate)
+                return temp;
+            candidate->name = "scratch";
+#ifdef ARENA_POSIX
+            pthread_once(&_arena_scratch_once, _arena_scratch_make_key);
+            pthread_setspecific(_arena_scratch_key, _arena_scratch);
+#endif
+            _arena_scratch[i] = candidate;
+        }
+
+        temp.arena = candidate;
+        temp.mark = _ARENA_PREFIX(mark)(candidate);
+        return temp;
+    }
+
+    _arena_last_error = ARENA_E_CONFLICT;
+    return temp;
+}
+
+/* ============================================================================
+ * arena_scratch_end - rewinds the scratch arena to where it was begun
+ * ============================================================================
+ */
+void _ARENA_PREFIX(scratch_end)(arena_temp_t temp)
+{
+    arena_rewind(temp.arena, temp.mark);
+}
+#endif /* ARENA_NOALLOC */
+
+#if defined(ARENA_POSIX) && !defined(ARENA_NOALLOC)
+/* ============================================================================
+ * arena_save - writes header + used bytes to path in a single writev()
+ * Returns 0 on success, -1 on failure (see arena_error).
+ * ============================================================================
+ */
+int _ARENA_PREFIX(save)(arena_t *arena, const char *path)
+{
+    unsigned char header[ARENA_FILE_HEADER_SIZE] = {0};
+    _arena_file_header *h = (_arena_file_header *)header;
+    struct iovec iov[2];
+    unsigned long pos;
+    int fd, i = 0;
+
+    if (!arena)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    ARENA_LOCK();
+
+    if (arena->blocks || arena->large)
+    {
+        _ARENA_FAIL(arena, ARENA_E_UNSUPPORTED);
+        ARENA_UNLOCK();
+        return -1;
+    }
+
+    pos = _arena_pos(arena);
+    h->magic = ARENA_FILE_MAGIC;
+    h->version = ARENA_FILE_VERSION;
+    h->capacity = pos;
+    h->pos = pos;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        _ARENA_FAIL(arena, ARENA_E_IO);
         ARENA_UNLOCK();
+        return -1;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = arena->data;
+    iov[1].iov_len = pos;
+
+    /* Usually one call; loop only on short writes */
+    while (i < 2)
+    {
+        ssize_t n = writev(fd, iov + i, 2 - i);
+        if (n < 0)
+        {
+            close(fd);
+            _ARENA_FAIL(arena, ARENA_E_IO);
+            ARENA_UNLOCK();
+            return -1;
+        }
+        while (i < 2 && (size_t)n >= iov[i].iov_len)
+            n -= (ssize_t)iov[i++].iov_len;
+        if (i < 2)
+        {
+            iov[i].iov_base = (unsigned char *)iov[i].iov_base + n;
+            iov[i].iov_len -= (size_t)n;
+        }
+    }
+
+    close(fd);
+    ARENA_UNLOCK();
+    return 0;
+}
+
+/* ============================================================================
+ * arena_load - maps a saved image read-only; contents are usable at once
+ * The returned arena rejects allocation and reset; arena_destroy unmaps it.
+ * ============================================================================
+ */
+arena_t *_ARENA_PREFIX(load)(const char *path)
+{
+    _arena_file_header h;
+    struct stat st;
+    unsigned char *map;
+    arena_t *arena;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        _arena_last_error = ARENA_E_IO;
         return NULL;
     }
 
-    void *ptr = arena->data + new_pos;
-    arena->pos = new_pos + size;
-    arena->error = "no error";
+    if (fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+        h.magic != ARENA_FILE_MAGIC || h.version != ARENA_FILE_VERSION || h.pos > h.capacity ||
+        (unsigned long)st.st_size < ARENA_FILE_HEADER_SIZE + h.capacity)
+    {
+        close(fd);
+        _arena_last_error = ARENA_E_FORMAT;
+        return NULL;
+    }
+
+    map = (unsigned char *)mmap(NULL, ARENA_FILE_HEADER_SIZE + h.pos, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == (unsigned char *)MAP_FAILED)
+    {
+        _arena_last_error = ARENA_E_IO;
+        return NULL;
+    }
+
+    ARENA_LOCK();
+
+    arena = (arena_t *)ARENA_MALLOC(sizeof(arena_t));
+    if (!arena)
+    {
+        munmap(map, ARENA_FILE_HEADER_SIZE + h.pos);
+        _arena_last_error = ARENA_E_NOMEM;
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    /* Full (capacity == pos), so every allocation is rejected */
+    _arena_setup(arena, map + ARENA_FILE_HEADER_SIZE, h.pos, h.pos,
+                 _ARENA_FLAG_READONLY | _ARENA_FLAG_MAPPED);
+    _arena_register(arena);
 
     ARENA_UNLOCK();
-    return ptr;
+    return arena;
 }
 
 /* ============================================================================
- * arena_reset - resets arena to reuse memory (pos = 0)
+ * arena_init_file - arena backed by a MAP_SHARED mapping of path
+ * A new (or empty) file is sized to hold size bytes; an existing arena file
+ * is reopened with its capacity and pos, growing it if size is larger.
  * ============================================================================
  */
-void _ARENA_PREFIX(reset)(arena_t *arena)
+arena_t *_ARENA_PREFIX(init_file)(const char *path, int size)
+{
+    _arena_file_header h;
+    struct stat st;
+    unsigned char *map;
+    arena_t *arena;
+    int fd;
+
+    if (size <= 0)
+    {
+        _arena_last_error = ARENA_E_SIZE;
+        return NULL;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        _arena_last_error = ARENA_E_IO;
+        return NULL;
+    }
+
+    if (st.st_size == 0)
+    {
+        h.magic = ARENA_FILE_MAGIC;
+        h.version = ARENA_FILE_VERSION;
+        h.capacity = 0;
+        h.pos = 0;
+    }
+    else if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic != ARENA_FILE_MAGIC ||
+             h.version != ARENA_FILE_VERSION || h.pos > h.capacity)
+    {
+        close(fd);
+        _arena_last_error = ARENA_E_FORMAT;
+        return NULL;
+    }
+
+    if (h.capacity < (unsigned long)size)
+        h.capacity = size;
+    if ((unsigned long)st.st_size < ARENA_FILE_HEADER_SIZE + h.capacity &&
+        ftruncate(fd, (off_t)(ARENA_FILE_HEADER_SIZE + h.capacity)) != 0)
+    {
+        close(fd);
+        _arena_last_error = ARENA_E_IO;
+        return NULL;
+    }
+
+    map = (unsigned char *)mmap(NULL, ARENA_FILE_HEADER_SIZE + h.capacity, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == (unsigned char *)MAP_FAILED)
+    {
+        _arena_last_error = ARENA_E_IO;
+        return NULL;
+    }
+    *(_arena_file_header *)map = h;
+
+    ARENA_LOCK();
+
+    arena = (arena_t *)ARENA_MALLOC(sizeof(arena_t));
+    if (!arena)
+    {
+        munmap(map, ARENA_FILE_HEADER_SIZE + h.capacity);
+        _arena_last_error = ARENA_E_NOMEM;
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    _arena_setup(arena, map + ARENA_FILE_HEADER_SIZE, h.capacity, h.pos,
+                 _ARENA_FLAG_MAPPED | _ARENA_FLAG_FILE);
+    _arena_register(arena);
+
+    ARENA_UNLOCK();
+    return arena;
+}
+
+/* ============================================================================
+ * arena_sync - stores pos in the file header and msync()s header + data
+ * Returns 0 on success, -1 on failure or if the arena is not file-backed.
+ * ============================================================================
+ */
+int arena_sync(arena_t *arena)
 {
+    unsigned char *map;
+    int rc;
+
     if (!arena)
-        return;
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
+
+    if (!(arena->flags & _ARENA_FLAG_FILE))
+    {
+        _ARENA_FAIL(arena, ARENA_E_UNSUPPORTED);
+        return -1;
+    }
 
     ARENA_LOCK();
 
-    arena->pos = 0;
-    arena->error = "no error";
+    map = arena->data - ARENA_FILE_HEADER_SIZE;
+    ((_arena_file_header *)map)->pos = arena->pos;
+    rc = msync(map, ARENA_FILE_HEADER_SIZE + arena->pos, MS_SYNC);
+    if (rc != 0)
+        _ARENA_FAIL(arena, ARENA_E_IO);
 
     ARENA_UNLOCK();
+    return rc == 0 ? 0 : -1;
 }
 
 /* ============================================================================
- * arena_destroy - frees arena memory (only for dynamic arena)
+ * _arena_shared_attach - waits, up to _ARENA_ATTACH_TRIES times 1 ms, for
+ * the creator of shared memory fd to size it and publish its header, then
+ * stores its capacity. Returns 0, or -1 if it never becomes an arena.
  * ============================================================================
  */
-#ifndef ARENA_NOALLOC
-void _ARENA_PREFIX(destroy)(arena_t *arena)
+#define _ARENA_ATTACH_TRIES 1000
+
+static int _arena_shared_attach(int fd, unsigned long *capacity)
+{
+    _arena_file_header *h = NULL;
+    struct timespec pause;
+    struct stat st;
+    int tries, rc = -1;
+
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000L;
+
+    for (tries = 0; tries < _ARENA_ATTACH_TRIES; tries++)
+    {
+        if (fstat(fd, &st) != 0)
+            break;
+        if (!h && (unsigned long)st.st_size >= ARENA_FILE_HEADER_SIZE)
+        {
+            h = (_arena_file_header *)mmap(NULL, ARENA_FILE_HEADER_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+            if (h == (_arena_file_header *)MAP_FAILED)
+                return -1;
+        }
+        if (h && _ARENA_ATOMIC_LOAD(&h->magic) == ARENA_FILE_MAGIC)
+        {
+            if (h->version == ARENA_FILE_VERSION &&
+                (unsigned long)st.st_size >= ARENA_FILE_HEADER_SIZE + h->capacity)
+            {
+                *capacity = h->capacity;
+                rc = 0;
+            }
+            break;
+        }
+        nanosleep(&pause, NULL);
+    }
+
+    if (h)
+        munmap(h, ARENA_FILE_HEADER_SIZE);
+    return rc;
+}
+
+/* ============================================================================
+ * arena_init_shared - arena whose header and data live in shared memory
+ * With name == NULL the region is an anonymous MAP_SHARED mapping that
+ * fork()ed children inherit. Otherwise it is the shm_open() object name:
+ * the first caller creates and sizes it, later callers attach to it (size
+ * is then ignored, and they wait up to a second for the creator). Allocation bumps the shared pos with a CAS; arena_reset
+ * rewinds it for every process. shm_unlink() the name when done.
+ * ============================================================================
+ */
+arena_t *_ARENA_PREFIX(init_shared)(const char *name, int size)
+{
+    _arena_file_header *h;
+    unsigned char *map;
+    unsigned long capacity = (unsigned long)size;
+    arena_t *arena;
+
+    if (size <= 0 && !name)
+    {
+        _arena_last_error = ARENA_E_SIZE;
+        return NULL;
+    }
+
+    if (!name)
+    {
+        map = (unsigned char *)mmap(NULL, ARENA_FILE_HEADER_SIZE + capacity, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (map == (unsigned char *)MAP_FAILED)
+        {
+            _arena_last_error = ARENA_E_IO;
+            return NULL;
+        }
+        h = (_arena_file_header *)map;
+        h->magic = ARENA_FILE_MAGIC;
+        h->version = ARENA_FILE_VERSION;
+        h->capacity = capacity;
+        h->pos = 0;
+    }
+    else
+    {
+        int created = 1;
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+        if (fd < 0)
+        {
+            created = 0;
+            fd = shm_open(name, O_RDWR, 0600);
+        }
+        if (fd < 0)
+        {
+            _arena_last_error = ARENA_E_IO;
+            return NULL;
+        }
+
+        if (created)
+        {
+            if (size <= 0 || ftruncate(fd, (off_t)(ARENA_FILE_HEADER_SIZE + capacity)) != 0)
+            {
+                close(fd);
+                shm_unlink(name);
+                _arena_last_error = ARENA_E_IO;
+                return NULL;
+            }
+        }
+        else if (_arena_shared_attach(fd, &capacity) != 0)
+        {
+            close(fd);
+            _arena_last_error = ARENA_E_FORMAT;
+            return NULL;
+        }
+
+        map = (unsigned char *)mmap(NULL, ARENA_FILE_HEADER_SIZE + capacity, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == (unsigned char *)MAP_FAILED)
+        {
+            _arena_last_error = ARENA_E_IO;
+            return NULL;
+        }
+
+        h = (_arena_file_header *)map;
+        if (created)
+        {
+            h->version = ARENA_FILE_VERSION;
+            h->capacity = capacity;
+            h->pos = 0;
+            _ARENA_ATOMIC_STORE(&h->magic, ARENA_FILE_MAGIC); /* Published last */
+        }
+    }
+
+    ARENA_LOCK();
+
+    arena = (arena_t *)ARENA_MALLOC(sizeof(arena_t));
+    if (!arena)
+    {
+        munmap(map, ARENA_FILE_HEADER_SIZE + capacity);
+        _arena_last_error = ARENA_E_NOMEM;
+        ARENA_UNLOCK();
+        return NULL;
+    }
+
+    _arena_setup(arena, map + ARENA_FILE_HEADER_SIZE, capacity, _ARENA_ATOMIC_LOAD(&h->pos),
+                 _ARENA_FLAG_MAPPED | _ARENA_FLAG_SHARED);
+    _arena_register(arena);
+
+    ARENA_UNLOCK();
+    return arena;
+}
+#endif /* ARENA_POSIX && !ARENA_NOALLOC */
+
+/* ============================================================================
+ * arena_set_name - labels arena in stats dumps; name is not copied
+ * ============================================================================
+ */
+void _ARENA_PREFIX(set_name)(arena_t *arena, const char *name)
 {
     if (!arena)
         return;
 
     ARENA_LOCK();
+    arena->name = name;
+    ARENA_UNLOCK();
+}
 
-    ARENA_FREE(arena->data);
-    ARENA_FREE(arena);
-    _arena_error_global = "no error";
+/* ============================================================================
+ * _arena_stats_locked - fills *stats; caller must hold ARENA_LOCK()
+ * ============================================================================
+ */
+static void _arena_stats_locked(arena_t *arena, arena_stats_t *stats)
+{
+    struct _arena_large *large;
+    struct _arena_block *b;
+    unsigned long pos = _arena_pos(arena);
+
+    stats->name = arena->name;
+    stats->capacity = arena->capacity;
+    stats->used = pos;
+    stats->blocks = 1;
+    for (b = arena->blocks; b; b = b->prev)
+    {
+        stats->capacity += b->capacity;
+        stats->used += b->pos;
+        stats->blocks++;
+    }
+    for (large = arena->large; large; large = large->next)
+    {
+        stats->capacity += large->size;
+        stats->used += large->size;
+        stats->blocks++;
+    }
+    stats->peak = arena->high_water > stats->used ? arena->high_water : stats->used;
+}
+
+/* ============================================================================
+ * arena_stats - snapshot of capacity, usage, peak and block count
+ * Returns 0 on success, -1 if arena or stats is NULL.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(stats)(arena_t *arena, arena_stats_t *stats)
+{
+    if (!arena || !stats)
+    {
+        _arena_last_error = ARENA_E_NULL;
+        return -1;
+    }
 
+    ARENA_LOCK();
+    _arena_stats_locked(arena, stats);
     ARENA_UNLOCK();
+    return 0;
+}
+
+#ifdef ARENA_REGISTRY
+/* ============================================================================
+ * Dump output - buffered writes to the caller's sink, no stdio needed
+ * ============================================================================
+ */
+struct _arena_out
+{
+    arena_write_fn write;
+    void *ctx;
+    unsigned long len;
+    char buf[256];
+};
+
+static void _arena_out_flush(struct _arena_out *out)
+{
+    if (out->len)
+        out->write(out->ctx, out->buf, out->len);
+    out->len = 0;
+}
+
+static void _arena_out_char(struct _arena_out *out, char c)
+{
+    if (out->len == sizeof(out->buf))
+        _arena_out_flush(out);
+    out->buf[out->len++] = c;
+}
+
+static void _arena_out_str(struct _arena_out *out, const char *str)
+{
+    while (*str)
+        _arena_out_char(out, *str++);
+}
+
+static void _arena_out_ulong(struct _arena_out *out, unsigned long value)
+{
+    char digits[24];
+    int n = 0;
+
+    do
+        digits[n++] = (char)('0' + value % 10);
+    while ((value /= 10) != 0);
+    while (n > 0)
+        _arena_out_char(out, digits[--n]);
+}
+
+/* Quoted and escaped JSON string */
+static void _arena_out_json_str(struct _arena_out *out, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    _arena_out_char(out, '"');
+    for (; *str; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\')
+        {
+            _arena_out_char(out, '\\');
+            _arena_out_char(out, (char)c);
+        }
+        else if (c < 0x20)
+        {
+            _arena_out_str(out, "\\u00");
+            _arena_out_char(out, hex[c >> 4]);
+            _arena_out_char(out, hex[c & 15]);
+        }
+        else
+            _arena_out_char(out, (char)c);
+    }
+    _arena_out_char(out, '"');
+}
+
+/* ============================================================================
+ * arena_dump_stats - writes one entry per registered arena to write(ctx, ...)
+ * format is ARENA_DUMP_TEXT (one line each) or ARENA_DUMP_JSON (an object
+ * with an "arenas" array). Returns the number of arenas listed, or -1.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(dump_stats)(arena_write_fn write, void *ctx, int format)
+{
+    struct _arena_out out;
+    arena_stats_t st;
+    int i, listed = 0;
+
+    if (!write || (format != ARENA_DUMP_TEXT && format != ARENA_DUMP_JSON))
+    {
+        _arena_last_error = ARENA_E_ARGUMENT;
+        return -1;
+    }
+
+    out.write = write;
+    out.ctx = ctx;
+    out.len = 0;
+
+    if (format == ARENA_DUMP_JSON)
+        _arena_out_str(&out, "{\"arenas\":[");
+
+    for (i = 0; i < ARENA_REGISTRY_SLOTS; i++)
+    {
+        arena_t *arena;
+
+        /* Re-read the slot under the lock so a concurrent destroy cannot free
+         * the arena while it is being read */
+        ARENA_LOCK();
+        arena = _ARENA_ATOMIC_LOAD(&_arena_registry[i]);
+        if (arena)
+            _arena_stats_locked(arena, &st);
+        ARENA_UNLOCK();
+        if (!arena)
+            continue;
+
+        if (format == ARENA_DUMP_JSON)
+        {
+            if (listed)
+                _arena_out_char(&out, ',');
+            _arena_out_str(&out, "{\"name\":");
+            if (st.name)
+                _arena_out_json_str(&out, st.name);
+            else
+                _arena_out_str(&out, "null");
+            _arena_out_str(&out, ",\"capacity\":");
+            _arena_out_ulong(&out, st.capacity);
+            _arena_out_str(&out, ",\"used\":");
+            _arena_out_ulong(&out, st.used);
+            _arena_out_str(&out, ",\"peak\":");
+            _arena_out_ulong(&out, st.peak);
+            _arena_out_str(&out, ",\"blocks\":");
+            _arena_out_ulong(&out, st.blocks);
+            _arena_out_char(&out, '}');
+        }
+        else
+        {
+            _arena_out_str(&out, st.name ? st.name : "(unnamed)");
+            _arena_out_str(&out, " capacity=");
+            _arena_out_ulong(&out, st.capacity);
+            _arena_out_str(&out, " used=");
+            _arena_out_ulong(&out, st.used);
+            _arena_out_str(&out, " peak=");
+            _arena_out_ulong(&out, st.peak);
+            _arena_out_str(&out, " blocks=");
+            _arena_out_ulong(&out, st.blocks);
+            _arena_out_char(&out, '\n');
+        }
+        listed++;
+    }
+
+    if (format == ARENA_DUMP_JSON)
+    {
+        _arena_out_str(&out, "],\"untracked\":");
+        _arena_out_ulong(&out, _ARENA_ATOMIC_LOAD(&_arena_registry_untracked));
+        _arena_out_str(&out, "}\n");
+    }
+    else if (_ARENA_ATOMIC_LOAD(&_arena_registry_untracked))
+    {
+        _arena_out_str(&out, "(untracked) count=");
+        _arena_out_ulong(&out, _ARENA_ATOMIC_LOAD(&_arena_registry_untracked));
+        _arena_out_char(&out, '\n');
+    }
+
+    _arena_out_flush(&out);
+    return listed;
+}
+#endif /* ARENA_REGISTRY */
+
+#ifdef ARENA_TRACE
+/* ============================================================================
+ * arena_trace_start - writes the trace header to write(ctx, ...) and starts
+ * recording into it. Returns 0 on success, -1 if write is NULL or a trace
+ * is already running.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(trace_start)(arena_write_fn write, void *ctx)
+{
+    unsigned long header[2];
+
+    if (!write || _ARENA_ATOMIC_LOAD(&_arena_trace_write))
+    {
+        _arena_last_error = ARENA_E_STATE;
+        return -1;
+    }
+
+    header[0] = ARENA_TRACE_MAGIC;
+    header[1] = ARENA_TRACE_VERSION;
+    write(ctx, (const char *)header, sizeof(header));
+
+    _arena_trace_ctx = ctx;
+    _ARENA_ATOMIC_STORE(&_arena_trace_write, write);
+    return 0;
+}
+
+/* ============================================================================
+ * arena_trace_flush - hands the calling thread's buffered records to the sink
+ * ============================================================================
+ */
+void _ARENA_PREFIX(trace_flush)(void)
+{
+    _arena_trace_flush_buffer(&_arena_trace_buf);
+}
+
+#ifdef ARENA_POSIX
+static int _arena_trace_fd = -1;
+
+static void _arena_trace_fd_write(void *ctx, const char *buf, unsigned long len)
+{
+    (void)ctx;
+    while (len > 0)
+    {
+        ssize_t n = write(_arena_trace_fd, buf, len);
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= (unsigned long)n;
+    }
+}
+
+/* ============================================================================
+ * arena_trace_open - arena_trace_start() into a new file at path
+ * Returns 0 on success, -1 on failure.
+ * ============================================================================
+ */
+int _ARENA_PREFIX(trace_open)(const char *path)
+{
+    int fd;
+
+    if (!path || _ARENA_ATOMIC_LOAD(&_arena_trace_write))
+    {
+        _arena_last_error = ARENA_E_STATE;
+        return -1;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        _arena_last_error = ARENA_E_IO;
+        return -1;
+    }
+
+    _arena_trace_fd = fd;
+    return _ARENA_PREFIX(trace_start)(_arena_trace_fd_write, NULL);
 }
 #endif
 
+/* ============================================================================
+ * arena_trace_stop - flushes the calling thread and stops recording
+ * Other threads should arena_trace_flush() first; records they still
+ * buffer are dropped. Closes the file of arena_trace_open().
+ * ============================================================================
+ */
+void _ARENA_PREFIX(trace_stop)(void)
+{
+    int expected = 0;
+
+    _arena_trace_flush_buffer(&_arena_trace_buf);
+
+    while (!_ARENA_ATOMIC_CAS(&_arena_trace_busy, &expected, 1))
+        expected = 0;
+    _ARENA_ATOMIC_STORE(&_arena_trace_write, (arena_write_fn)NULL);
+    _arena_trace_ctx = NULL;
+#ifdef ARENA_POSIX
+    if (_arena_trace_fd >= 0)
+    {
+        close(_arena_trace_fd);
+        _arena_trace_fd = -1;
+    }
+#endif
+    _ARENA_ATOMIC_STORE(&_arena_trace_busy, 0);
+}
+#endif /* ARENA_TRACE */
+
 /* ============================================================================
  * arena_used - returns number of bytes currently allocated (internal)
  * ============================================================================
  */
-static inline unsigned long _ARENA_PREFIX(used)(arena_t *arena)
+ARENA_INLINE unsigned long _ARENA_PREFIX(used)(arena_t *arena)
 {
+    struct _arena_large *large;
+    struct _arena_block *b;
+    unsigned long used;
+
     if (!arena)
         return 0;
-    return arena->pos;
+
+    used = _arena_pos(arena);
+    for (b = arena->blocks; b; b = b->prev)
+        used += b->pos;
+    for (large = arena->large; large; large = large->next)
+        used += large->size;
+    return used;
 }
 
 /* ============================================================================
  * arena_capacity - returns total capacity of arena (internal)
  * ============================================================================
  */
-static inline unsigned long _ARENA_PREFIX(capacity)(arena_t *arena)
+ARENA_INLINE unsigned long _ARENA_PREFIX(capacity)(arena_t *arena)
 {
     if (!arena)
         return 0;
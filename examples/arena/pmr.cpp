@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define ARENA_IMPLEMENTATION
+#define ARENA_CXX
+
+#include "../../arena.h"
+
+void *_arena_alloc(unsigned long size)
+{
+    return malloc(size);
+}
+
+void _arena_free(void *ptr)
+{
+    free(ptr);
+}
+
+static const int ROUNDS = 2000;
+static const int ITEMS = 1000;
+static const int ARENA_BYTES = 1 << 20;
+
+// Simulated request handler: fill a vector and a hash map, then drop both
+template <typename Vector, typename Map>
+static long handle_request(Vector &v, Map &m)
+{
+    long sum = 0;
+    for (int i = 0; i < ITEMS; i++)
+    {
+        v.push_back(i);
+        m.emplace(i, i * 2);
+    }
+    for (int i = 0; i < ITEMS; i++)
+        sum += v[i] + m.find(i)->second;
+    return sum;
+}
+
+int main(void)
+{
+    arena_t *arena = arena_init(ARENA_BYTES);
+    if (!arena)
+    {
+        fprintf(stderr, "Arena init error: %s\n", arena_error(NULL));
+        return 1;
+    }
+
+    std::vector<unsigned char> buffer(ARENA_BYTES);
+    long check = 0;
+
+    // arena::memory_resource, reset between requests
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        arena::memory_resource res(arena);
+        {
+            std::pmr::vector<int> v(&res);
+            std::pmr::unordered_map<int, int> m(&res);
+            check += handle_request(v, m);
+        }
+        arena_reset(arena);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    // std::pmr::monotonic_buffer_resource over a buffer of the same size
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        std::pmr::monotonic_buffer_resource res(buffer.data(), buffer.size(),
+                                                std::pmr::null_memory_resource());
+        std::pmr::vector<int> v(&res);
+        std::pmr::unordered_map<int, int> m(&res);
+        check -= handle_request(v, m);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    // arena::allocator<T> with plain std containers
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        {
+            typedef arena::allocator<std::pair<const int, int>> pair_alloc;
+            std::vector<int, arena::allocator<int>> v{arena::allocator<int>(arena)};
+            std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, pair_alloc> m(
+                0, std::hash<int>(), std::equal_to<int>(), pair_alloc(arena));
+            check += handle_request(v, m);
+        }
+        arena_reset(arena);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    typedef std::chrono::duration<double, std::micro> usec;
+    printf("arena::memory_resource        %8.2f us/request\n", usec(t1 - t0).count() / ROUNDS);
+    printf("monotonic_buffer_resource     %8.2f us/request\n", usec(t2 - t1).count() / ROUNDS);
+    printf("arena::allocator<T>           %8.2f us/request\n", usec(t3 - t2).count() / ROUNDS);
+    printf("checksum %ld\n", check);
+
+    arena_destroy(arena);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * replay - re-runs an ARENA_TRACE recording against this build of arena.h
+ *
+ *   replay TRACE [-c CAPACITY] [-s PERCENT] [-r RETAIN]
+ *
+ *   -c  give every arena CAPACITY bytes instead of the recorded size
+ *   -s  scale recorded capacities to PERCENT percent
+ *   -r  arena_set_retain(RETAIN) on every arena
+ *
+ * Reports the replay time, allocations that failed under the new
+ * configuration, and the peak footprint (capacity of all live arenas) and
+ * peak bytes in use.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ARENA_IMPLEMENTATION
+
+#include "../../arena.h"
+
+void *_arena_alloc(unsigned long size)
+{
+    return malloc(size);
+}
+
+void _arena_free(void *ptr)
+{
+    free(ptr);
+}
+
+typedef struct
+{
+    arena_trace_event_t ev;
+    unsigned long seq; /* File position, breaks time ties */
+} record_t;
+
+/* Records of different threads are interleaved in flush order, so replay
+ * in time order */
+static int by_time(const void *a, const void *b)
+{
+    const record_t *x = (const record_t *)a, *y = (const record_t *)b;
+    if (x->ev.time_ns != y->ev.time_ns)
+        return x->ev.time_ns < y->ev.time_ns ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long capacity = 0, percent = 100, retain = 0, count, i, ids = 0;
+    unsigned long footprint = 0, peak_footprint = 0, used = 0, peak_used = 0;
+    unsigned long allocs = 0, failed = 0, unknown = 0;
+    unsigned long header[2];
+    record_t *records;
+    arena_t **arenas;
+    long size;
+    double t0, t1;
+    FILE *f;
+    int a;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s TRACE [-c CAPACITY] [-s PERCENT] [-r RETAIN]\n", argv[0]);
+        return 2;
+    }
+    for (a = 2; a + 1 < argc; a += 2)
+    {
+        unsigned long v = strtoul(argv[a + 1], NULL, 0);
+        if (!strcmp(argv[a], "-c"))
+            capacity = v;
+        else if (!strcmp(argv[a], "-s"))
+            percent = v;
+        else if (!strcmp(argv[a], "-r"))
+            retain = v;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (!f || fread(header, sizeof(header), 1, f) != 1 || header[0] != ARENA_TRACE_MAGIC ||
+        header[1] != ARENA_TRACE_VERSION)
+    {
+        fprintf(stderr, "%s: not an arena trace\n", argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f) - (long)sizeof(header);
+    fseek(f, (long)sizeof(header), SEEK_SET);
+
+    count = (unsigned long)size / sizeof(arena_trace_event_t);
+    records = (record_t *)malloc((count ? count : 1) * sizeof(record_t));
+    for (i = 0; i < count; i++)
+    {
+        if (fread(&records[i].ev, sizeof(arena_trace_event_t), 1, f) != 1)
+            break;
+        records[i].seq = i;
+        if (records[i].ev.arena >= ids)
+            ids = records[i].ev.arena + 1;
+    }
+    fclose(f);
+    count = i;
+    qsort(records, count, sizeof(record_t), by_time);
+
+    arenas = (arena_t **)calloc(ids ? ids : 1, sizeof(arena_t *));
+
+    t0 = now_sec();
+    for (i = 0; i < count; i++)
+    {
+        const arena_trace_event_t *ev = &records[i].ev;
+        arena_t *arena = arenas[ev->arena];
+        arena_stats_t st;
+
+        if (ev->type == ARENA_TRACE_INIT)
+        {
+            unsigned long cap = capacity ? capacity : (unsigned long)((double)ev->size * percent / 100);
+            if (arena)
+                continue; /* Recorded id reused; keep the first */
+            arena = arenas[ev->arena] = arena_init((int)cap);
+            if (!arena)
+            {
+                failed++;
+                continue;
+            }
+            if (retain)
+                arena_set_retain(arena, retain);
+            footprint += cap;
+            if (footprint > peak_footprint)
+                peak_footprint = footprint;
+            continue;
+        }
+
+        if (!arena)
+        {
+            unknown++; /* Arena created before the trace started */
+            continue;
+        }
+
+        arena_stats(arena, &st);
+        used -= st.used;
+
+        switch (ev->type)
+        {
+        case ARENA_TRACE_ALLOC:
+            allocs++;
+            if (!arena_alloc(arena, (int)ev->size))
+                failed++;
+            break;
+        case ARENA_TRACE_ALLOC_ALIGNED:
+            allocs++;
+            if (!arena_alloc_aligned(arena, (int)ev->size, (int)ev->alignment))
+                failed++;
+            break;
+        case ARENA_TRACE_RESET:
+            arena_reset(arena);
+            break;
+        case ARENA_TRACE_DESTROY:
+            footprint -= st.capacity;
+            arena_destroy(arena);
+            arenas[ev->arena] = NULL;
+            continue;
+        }
+
+        arena_stats(arena, &st);
+        used += st.used;
+        if (used > peak_used)
+            peak_used = used;
+    }
+    t1 = now_sec();
+
+    printf("events            %lu (%lu allocations)\n", count, allocs);
+    if (count > 1)
+        printf("recorded time     %.3f ms\n",
+               (double)(records[count - 1].ev.time_ns - records[0].ev.time_ns) / 1e6);
+    printf("replay time       %.3f ms\n", (t1 - t0) * 1e3);
+    printf("failed            %lu\n", failed);
+    printf("peak footprint    %lu bytes\n", peak_footprint);
+    printf("peak in use       %lu bytes\n", peak_used);
+    if (unknown)
+        printf("skipped           %lu events on arenas created before tracing\n", unknown);
+
+    for (i = 0; i < ids; i++)
+        arena_destroy(arenas[i]);
+    free(arenas);
+    free(records);
+    return 0;
+}
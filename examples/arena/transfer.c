@@ -0,0 +1,102 @@
+/*
+ * transfer - hands a stage's output to the next stage with arena_transfer
+ *
+ * Also checks that a transfer which would move src's own cleanup nodes
+ * (registered before the mark, in the block that moves) is refused.
+ * Exits with 0 if every check passes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_IMPLEMENTATION
+
+#include "../../arena.h"
+
+void *_arena_alloc(unsigned long size)
+{
+    return malloc(size);
+}
+
+void _arena_free(void *ptr)
+{
+    free(ptr);
+}
+
+static int cleanups_run;
+
+static void count_cleanup(void *ctx)
+{
+    (void)ctx;
+    cleanups_run++;
+}
+
+/* Pre-mark cleanup in the moved block: must fail, src stays intact */
+static int check_refused(void)
+{
+    arena_t *src = arena_init(4096);
+    arena_t *dst = arena_init(4096);
+    arena_mark_t m;
+
+    arena_strdup(src, "before the mark");
+    arena_add_cleanup(src, count_cleanup, NULL);
+    m = arena_mark(src);
+    arena_strdup(src, "after the mark");
+
+    if (arena_transfer(dst, src, m) != -1 || arena_last_error() != ARENA_E_MARK)
+    {
+        fprintf(stderr, "transfer with a pre-mark cleanup was not refused\n");
+        return 1;
+    }
+
+    cleanups_run = 0;
+    arena_destroy(dst);
+    arena_destroy(src);
+    if (cleanups_run != 1)
+    {
+        fprintf(stderr, "expected 1 cleanup, ran %d\n", cleanups_run);
+        return 1;
+    }
+    return 0;
+}
+
+/* Plain handoff: data and its cleanup move to dst and outlive src's reset */
+static int check_handoff(void)
+{
+    arena_t *src = arena_init(4096);
+    arena_t *dst = arena_init(4096);
+    arena_mark_t m = arena_mark(src);
+    char *msg = arena_strdup(src, "hello from stage a");
+
+    arena_add_cleanup(src, count_cleanup, NULL);
+    if (arena_transfer(dst, src, m) != 0)
+    {
+        fprintf(stderr, "transfer failed: %s\n", arena_error(src));
+        return 1;
+    }
+
+    cleanups_run = 0;
+    arena_reset(src);
+    if (cleanups_run != 0 || strcmp(msg, "hello from stage a") != 0)
+    {
+        fprintf(stderr, "handed-off data did not survive src's reset\n");
+        return 1;
+    }
+
+    arena_destroy(src);
+    arena_destroy(dst);
+    if (cleanups_run != 1)
+    {
+        fprintf(stderr, "expected dst to run 1 cleanup, ran %d\n", cleanups_run);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    if (check_refused() || check_handoff())
+        return 1;
+    puts("transfer: ok");
+    return 0;
+}